@@ -0,0 +1,106 @@
+/*
+ *  CommandLine.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "CommandLine.h"
+
+static uint8_t _rx[COMMAND_RX_SIZE];
+
+static bool isSeparator(uint8_t c)
+{
+    return c == ';' || c == '\r' || c == '\n';
+}
+
+CommandLine::CommandLine() : _head(0), _count(0), _overruns(0), _skipping(false)
+{
+}
+
+void CommandLine::poll()
+{
+    while (Serial.available()) {
+        int _c = Serial.read();
+        if (_c < 0)
+            break;
+        if (_count == COMMAND_RX_SIZE) {
+            _overruns++;
+            continue;
+        }
+        _rx[(_head + _count++) % COMMAND_RX_SIZE] = _c;
+    }
+}
+
+uint8_t CommandLine::at(uint16_t i) const
+{
+    return _rx[(_head + i) % COMMAND_RX_SIZE];
+}
+
+void CommandLine::drop(uint16_t n)
+{
+    _head = (_head + n) % COMMAND_RX_SIZE;
+    _count -= n;
+}
+
+int CommandLine::read()
+{
+    if (!_count)
+        return -1;
+    uint8_t _c = at(0);
+    drop(1);
+    return _c;
+}
+
+int CommandLine::peek() const
+{
+    return _count ? at(0) : -1;
+}
+
+CommandLine::Next CommandLine::next(char *command, uint8_t size)
+{
+    for (;;) {
+        uint16_t _end = 0;
+        while (_end < _count && !isSeparator(at(_end)))
+            _end++;
+        if (_skipping) {
+            // the tail of a command already reported
+            drop(_end < _count ? _end + 1 : _count);
+            if (_end == _count)
+                return NONE;
+            _skipping = false;
+            continue;
+        }
+
+        uint16_t _start = 0;
+        while (_start < _end && at(_start) == ' ')
+            _start++;
+        if (_end == _count) {
+            // no separator yet - unless the ring is full, wait for the rest
+            if (_count < COMMAND_RX_SIZE)
+                return NONE;
+            _skipping = true;
+        }
+        uint16_t _len = _end;
+        while (_len > _start && at(_len - 1) == ' ')
+            _len--;
+        _len -= _start;
+
+        bool _fits = !_skipping && _len < size && _len <= COMMAND_MAX;
+        if (!_fits) {
+            // the first word, to say which command it was
+            _len = 0;
+            while (_len + 1 < size && _start + _len < _end && at(_start + _len) != ' ')
+                _len++;
+        }
+        for (uint16_t i = 0; i < _len; i++)
+            command[i] = at(_start + i);
+        command[_len] = 0;
+        drop(_skipping ? _count : _end + 1);
+        if (!_fits)
+            return TOO_LONG;
+        if (_len)
+            return COMMAND;
+        // empty, between the CR and LF of a line end or two ';', try the next one
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ *  CommandLine.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Console input with type-ahead.
+ *
+ *  poll() moves whatever the serial driver has received into a static ring
+ *  buffer, once per pass through loop(), so nothing typed or streamed while
+ *  a transition runs is lost.  The menu reads it a key at a time; batch mode
+ *  takes whole commands, separated by ';' or a line end, with next().
+ */
+
+#ifndef COMMANDLINE_H_
+#define COMMANDLINE_H_
+
+#include <application.h>
+
+#define COMMAND_RX_SIZE     256     // bytes of type-ahead
+#define COMMAND_MAX         40      // longest command, longer ones are reported
+
+class CommandLine {
+public:
+    CommandLine();
+
+    void poll();                        // Serial -> ring
+    int available() const { return _count; }
+    int read();
+    int peek() const;
+
+    enum Next { NONE, COMMAND, TOO_LONG };
+
+    // Next complete command, trimmed and NUL terminated.  Runs of separators
+    // (a CR LF) give no empty commands; one over COMMAND_MAX, or with no
+    // separator before the ring fills, is dropped up to its separator and
+    // comes back as TOO_LONG with its first word in command.
+    Next next(char *command, uint8_t size);
+
+    uint16_t overruns() const { return _overruns; }
+
+private:
+    uint8_t at(uint16_t i) const;
+    void drop(uint16_t n);
+
+    uint16_t _head;
+    uint16_t _count;
+    uint16_t _overruns;                 // bytes lost with the ring full
+    bool _skipping;                     // dropping the rest of a command too long
+};
+
+#endif /* COMMANDLINE_H_ */
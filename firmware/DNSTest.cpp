@@ -29,6 +29,25 @@
  *          [7] Connect / Disconnect Cloud
  *          [8] Test DNS lookup
  *          [9] Fix DNS
+ *          [b] Benchmark DNS lookup
+ *          [c] Show DNS cache
+ *          [r] UDP resolver On / Off
+ *          [u] Benchmark UDP DNS lookup
+ *          [o] Show output stats
+ *          [t] Dump trace as CSV
+ *          [j] Dump trace as JSON lines
+ *          [x] Dump the network recording, for replay on the host
+ *          [s] Soak test - 100 WiFi disconnect / connect cycles, any key stops it
+ *          [p] Soak test - 100 CC3000 off / on cycles
+ *          [l] Show the soak log as CSV
+ *          [h] Probe several hosts at once
+ *          [g] HTTP GET throughput of USER_HTTP_TARGET
+ *          [w] DNS watchdog On / Off - fixes a bad DNS server without being asked
+ *          [f] DNS fast path On / Off - lookups go to the gateway and USER_DNS over
+ *              UDP while the DNS server is bad, the watchdog fix waits 10 minutes
+ *          [k] Keep-alive test - 10 requests on one connection, new vs reused latency
+ *          [>] Batch mode - commands such as "on; connect; test x100; fixdns; off",
+ *              one status line each, "help" lists them
  *
  *
  *   NOTE:  When you use Reset IP it will force the IP addresses set below into the Spark
@@ -36,6 +55,21 @@
  */
 
 #include <application.h>
+#include "IPv4.h"
+#include "NetConfig.h"
+#include "NetTask.h"
+#include "NetState.h"
+#include "DnsBench.h"
+#include "DnsCache.h"
+#include "DnsResolver.h"
+#include "SerialOut.h"
+#include "Trace.h"
+#include "CommandLine.h"
+#include "Soak.h"
+#include "Probe.h"
+#include "Throughput.h"
+#include "KeepAlive.h"
+#include "DnsWatchdog.h"
 
 SYSTEM_MODE(MANUAL)
 
@@ -50,94 +84,43 @@ SYSTEM_MODE(MANUAL)
 #define USER_NETMASK           255, 255, 255, 0
 #define USER_GATEWAY           192, 168, 1, 1
 #define USER_DNS               192, 168, 1, 1
+#define USER_BENCH_HOSTS       "data.sparkfun.com", "www.google.com", "api.particle.io"
+#define USER_PROBE_HOSTS       "data.sparkfun.com", "www.google.com", "api.particle.io", \
+                               "device.spark.io", "example.com"
+#define USER_HTTP_TARGET       "data.sparkfun.com/"    // host[:port]/path for the throughput test
+
+// The static configuration, packed and checked by the compiler
+constexpr IPv4Config userConfig = {
+    IPv4(USER_IPADDRESS), IPv4(USER_NETMASK), IPv4(USER_GATEWAY), IPv4(USER_DNS)
+};
+static_assert(userConfig.valid(), "USER_IPADDRESS, USER_NETMASK, USER_GATEWAY and USER_DNS are not a usable network");
 
 // Global variables
-bool bWiFiEnable;
-bool bWiFiConnect;
-bool bCloudConnect;
+NetState net;   // CC3000, WiFi and cloud state, a fresh copy each pass through loop()
 bool bGoodDNS;
-uint8_t badDNS[] = { 0, 0, 83, 76};   // the TI chip bad DNS
-char _buf[20];
-char _strMacAddress[18];
-
-char *MacAddress2Str(byte *_mac, bool bReverse = false)
-{
-	if (bReverse)
-		// if the mac is from WiFi.macAddress use this
-		sprintf(_strMacAddress, "%02x:%02x:%02x:%02x:%02x:%02x",
-            _mac[5], _mac[4], _mac[3], _mac[2], _mac[1], _mac[0]);
-	else
-        // if the mac is from nvmem_get_mac_address use this
-		sprintf(_strMacAddress, "%02x:%02x:%02x:%02x:%02x:%02x",
-            _mac[0], _mac[1], _mac[2], _mac[3], _mac[4], _mac[5]);
-	return _strMacAddress;
-}
-
-void printIP(byte *_addr) {
-	sprintf(_strMacAddress, "%i.%i.%i.%i", _addr[3], _addr[2], _addr[1], _addr[0]);
-    if (!memcmp(badDNS, _addr, sizeof(badDNS)))
-    	sprintf(_buf,"%-15s * |", _strMacAddress);
-    else
-    	sprintf(_buf,"%-17s |", _strMacAddress);
-	Serial.println(_buf);
-}
-
-void printIPAddr(IPAddress _addr) {
-	sprintf(_strMacAddress, "%i.%i.%i.%i", _addr[0], _addr[1], _addr[2], _addr[3]);
-	sprintf(_buf,"%-17s |", _strMacAddress);
-	Serial.println(_buf);
-}
 
-/*
- *  Helper that takes an IP address and turns it into a 32 bit int
- */
-uint32_t IP2U32(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
-  uint32_t ip = a;
-  ip <<= 8;
-  ip |= b;
-  ip <<= 8;
-  ip |= c;
-  ip <<= 8;
-  ip |= d;
-
-  return ip;
-}
-
-bool setStaticIPAddress(uint32_t ip, uint32_t subnetMask, uint32_t defaultGateway, uint32_t dnsServer)
-{
-    // Reverse order of bytes in parameters so IP2U32 packed values can be used with the netapp_dhcp function.
-    ip = (ip >> 24) | ((ip >> 8) & 0x0000FF00L) | ((ip << 8) & 0x00FF0000L) | (ip << 24);
-    subnetMask = (subnetMask >> 24) | ((subnetMask >> 8) & 0x0000FF00L) | ((subnetMask << 8) & 0x00FF0000L) | (subnetMask << 24);
-    defaultGateway = (defaultGateway >> 24) | ((defaultGateway >> 8) & 0x0000FF00L) | ((defaultGateway << 8) & 0x00FF0000L) | (defaultGateway << 24);
-    dnsServer = (dnsServer >> 24) | ((dnsServer >> 8) & 0x0000FF00L) | ((dnsServer << 8) & 0x00FF0000L) | (dnsServer << 24);
-
-    // Update DHCP state with specified values.
-    if (netapp_dhcp(&ip, &subnetMask, &defaultGateway, &dnsServer) != 0) {
-      return false;
-    }
-
-    // Reset CC3000 to use modified setting.
-    wlan_stop();
-    delay(200);
-    wlan_start(0);
-    return true;
+// The value column of the status table, 17 wide
+void printCell(const char *_text) {
+    serialOut.cell(_text, 17);
+    serialOut.println(" |");
 }
 
-/**************************************************************************/
-/*!
-    @brief    Set the CC3000 to use request an IP and network configuration
-              using DHCP.  Note that this DHCP state will be saved in the
-              CC3000's non-volatile storage and reused on next reconnect.
-              This means you only need to call this once and the CC3000 will
-              remember the setting forever.  To switch to use a static IP,
-              call the cc3000.setStaticIPAddress function.
+void printMacAddress(byte *_mac, bool bReverse = false) {
+    char _str[18];
+    // reversed if the mac is from WiFi.macAddress, not if from nvmem_get_mac_address
+    formatMac(_str, _mac, bReverse);
+    printCell(_str);
+}
 
-    @returns  False if an error occurred, true if successfully set.
-*/
-/**************************************************************************/
-bool setDHCP()
-{
-    return setStaticIPAddress(0,0,0,0);
+// _bad marks it with *
+void printIP(IPv4 _ip, bool _bad = false) {
+    char _str[16];
+    formatIPv4(_str, _ip);
+    if (_bad) {
+        serialOut.cell(_str, 15);
+        serialOut.println(" * |");
+    } else
+        printCell(_str);
 }
 
 void setDNSIP() {
@@ -150,420 +133,1025 @@ void setDNSIP() {
      to using DHCP, call the setDHCP() function (again only needs
      to be called once).
 */
-    uint32_t ipAddress = IP2U32(USER_IPADDRESS);
-    uint32_t netMask = IP2U32(USER_NETMASK);
-    uint32_t defaultGateway = IP2U32(USER_GATEWAY);
-    uint32_t dns = IP2U32(USER_DNS);
-    if (!setStaticIPAddress(ipAddress, netMask, defaultGateway, dns)) {
-        Serial.println("Failed to set static IP!");
+    if (!setStaticIPAddress(userConfig)) {
+        serialOut.println("Failed to set static IP!");
+        serialOut.flush();
         while(1);
     }
 }
 
 #define MAX_CONNECT_RETRY 5  // Used by the test function for the number of attempts to connect to the test server
-#define MAX_WIFI_RETRY 100  // Used by fixDNS for the number of times in the loop to wait for the WiFi to complete
-
-// CAUTION, This function is aggressive and may damage the hardware
-// use at your own risk, it is disabled by default
-void fixDNS() {
-    // start with the WiFi connected to the AP
-	// check if we have a bad DNS address 76.83.0.0
-	// make sure the CC3000 knows we want to use DHCP
-	// disconnect from the AP
-	// make sure the CC3000 knows we want to use DHCP
-	// reconnect to the AP
-	// go to the beginning and if we still have a bad DNS IP then do it all over again.
-
-	// the bad DNS ip address
-	uint8_t badDNS[] = { 0, 0, 83, 76};   // the TI chip bad DNS ip
-	bool bGoodDNS = false;
-    uint8_t _timeout;
-    uint8_t _resetTimeout = 5;
-
-
-    while (!bGoodDNS && _resetTimeout-- > 0) {
-    	Serial.print("Attempt #");
-    	Serial.println(5-_resetTimeout);
-    	// start with the WiFi connected to the AP
-        if (!bWiFiConnect) {
-		    Serial.println("Connecting to AP");
-		    WiFi.connect();
-		    Serial.print("Waiting for WiFi to connect ");
-		    _timeout = 0;
-		    while (_timeout++ < MAX_WIFI_RETRY && !WiFi.ready()) { Serial.print("+"); Particle.process(); delay(100);}
-            while (ip_config.aucDNSServer[3] == 0 && ip_config.aucDNSServer[2] == 0) { Serial.print("-"); Particle.process(); delay(100); }
-		    _timeout = 0;
-            while (_timeout++ < (MAX_WIFI_RETRY/2) &&  ip_config.aucDNSServer[3] == 76 && ip_config.aucDNSServer[2] == 83) { Serial.print("*"); Particle.process(); delay(100); }
-            if (_timeout == MAX_WIFI_RETRY) {
-                Serial.print("Failed to connect to WiFi router - credentials ");
-                Serial.println(WiFi.hasCredentials() ? "known" : "unknown");
-                bGoodDNS = true;  // bail!!
-            }
-            else Serial.println();
-            bWiFiConnect = WiFi.ready();
-        }
-
-        // check if we have a bad DNS address 76.83.0.0
-	    if (!memcmp(badDNS, ip_config.aucDNSServer, sizeof(badDNS))) {
-            // make sure the CC3000 knows we want to use DHCP
-            Serial.println("Resetting CC3000 to DHCP while connected");
-            setStaticIPAddress(0,0,0,0);
-            delay(500);
-
-            // disconnect from the AP
-            Serial.println("Disconnecting from AP");
-            WiFi.disconnect();
-            Serial.print("Waiting for WiFi to disconnect ");
-            _timeout = 0;
-            while (_timeout < MAX_WIFI_RETRY && WiFi.ready()) { Serial.print("-"); Particle.process(); _timeout++; delay(100); }
-            while (ip_config.aucDNSServer[3] != 0 || ip_config.aucDNSServer[2] != 0) { Serial.print("-"); Particle.process(); delay(100); }
-            Serial.println();
-            bWiFiConnect = false;
-            bCloudConnect = false;
-
-            // make sure the CC3000 knows we want to use DHCP
-            Serial.println("Resetting CC3000 to DHCP while not connected");
-            setStaticIPAddress(0,0,0,0);
-            delay(500);
-        } else {
-		    bGoodDNS = true;
-            Serial.println("Success!");
-        }
-	}
-}
 
 void resetDNS() {
-    Serial.println("Resetting DNS IP");
+    serialOut.println("Resetting DNS IP");
     setDNSIP();
 }
 
 void dumpIP() {
-	Serial.print("\r\n");
-    Serial.println("+---------------------------------+");
-    Serial.println("|        DNS Test App v2.0        |");
-    Serial.println("|    Scott Piette Jan 14, 2015    |");
-
-    Serial.println("+-------------+-------------------+");
-	Serial.print("| CC30000     | ");
-	Serial.println(bWiFiEnable?"On                |":"Off               |");
-    if (bWiFiEnable) {
+    serialOut.beginRender();
+	serialOut.print("\r\n");
+    serialOut.println("+---------------------------------+");
+    serialOut.println("|        DNS Test App v2.0        |");
+    serialOut.println("|    Scott Piette Jan 14, 2015    |");
+
+    serialOut.println("+-------------+-------------------+");
+	serialOut.print("| CC30000     | ");
+	serialOut.println(net.powered?"On                |":"Off               |");
+    if (net.powered) {
         uint8_t mac[6];
-    	Serial.print("|   Mac Addr  | ");
-        if (bWiFiConnect)
+    	serialOut.print("|   Mac Addr  | ");
+        if (net.ready)
             WiFi.macAddress(mac);  // use this function if the CC3000 is on and WiFi connected
         else
         	nvmem_get_mac_address(mac); // use this function only the CC3000 is on
-        Serial.print(MacAddress2Str(mac, bWiFiConnect));
-        Serial.println(" |");
+        printMacAddress(mac, net.ready);
 	}
-    Serial.println("|-------------+-------------------|");
-	  Serial.print("| WiFi        | ");
-	Serial.println(bWiFiConnect?   "Connected         |":"Not Connected     |");
-    if (bWiFiConnect) {
-		Serial.print("|   SSID      | ");
-		sprintf(_buf,"%-17s |", WiFi.SSID());
-		Serial.println(_buf);
-    	Serial.print("|   RSSI      | ");
-		sprintf(_buf,"%-17i |", WiFi.RSSI());
-		Serial.println(_buf);
-        Serial.print("|   Local IP  | ");
-        printIPAddr(WiFi.localIP());
+    serialOut.println("|-------------+-------------------|");
+	  serialOut.print("| WiFi        | ");
+	serialOut.println(net.ready?   "Connected         |":"Not Connected     |");
+    if (net.ready) {
+		serialOut.print("|   SSID      | ");
+		printCell(net.ssid);
+    	serialOut.print("|   RSSI      | ");
+        char _rssi[12];
+        formatInt(_rssi, WiFi.RSSI());
+		printCell(_rssi);
+        serialOut.print("|   Local IP  | ");
+        printIP(net.ip);
     }
-	if (bWiFiConnect) {
-		Serial.print("|   Subnet    | ");
-		printIPAddr(WiFi.subnetMask());
-		Serial.print("|   Gateway   | ");
-		printIPAddr(WiFi.gatewayIP());
-	    Serial.print("|   DNS IP    | ");
-		printIP(ip_config.aucDNSServer);
+	if (net.ready) {
+		serialOut.print("|   Subnet    | ");
+		printIP(net.mask);
+		serialOut.print("|   Gateway   | ");
+		printIP(net.gateway);
+	    serialOut.print("|   DNS IP    | ");
+		printIP(net.dns, net.dnsBad);
 	}
-    Serial.println("|-------------+-------------------|");
-	  Serial.print("| Spark Cloud | ");
-	Serial.println(bCloudConnect?"Connected         |":"Not Connected     |");
-    Serial.println("+-------------+-------------------+");
+    serialOut.println("|-------------+-------------------|");
+	  serialOut.print("| Spark Cloud | ");
+	serialOut.println(net.cloud?"Connected         |":"Not Connected     |");
+    serialOut.println("+-------------+-------------------+");
+    serialOut.endRender();
 }
 
 #define MAX_CONNECT_TIMEOUT 100  // How many times in while loop to wait for connection
-int connectHttpServerHost(char *_host) {
-    int  _ret;
+DnsResolver dnsResolver; // UDP lookups racing the DHCP DNS, gateway and USER_DNS
+DnsCache dnsCache;       // host name -> IP, so connects skip the resolver when they can
+
+/*
+ *  Connect to _host:80 and wait for the first byte.  The name is looked up
+ *  by the CC3000 every time - a cached address would pass with the DNS
+ *  server stuck at 76.83.0.0, which is what this test is for.
+ */
+int connectHttpServerHost(const char *_host) {
+    int _ret = 0;
     int _timeout;
     TCPClient _client;
-    int8_t _c;
     uint8_t _message[] = { 'G', 'E', 'T', '\n', '\n' };
 
-    //Serial.println("Starting client.connect");
-    if(_client.connect(_host, 80)) {
-	    //Serial.println("After client.connect()");
-	    _timeout = 0;
-	    while ( _timeout < MAX_CONNECT_TIMEOUT && !_client.connected()) {
-	        //if (!_timeout) Serial.print("Waiting for connect ");
-	        //else Serial.print(".");
-	        delay(10);
-	        ++_timeout;
-	    }
-	    //if (_timeout) Serial.println("");
-	    //Serial.print("Sending");
-	    _client.write(_message, 5);
-	    _timeout = 0;
-	    while (_timeout < MAX_CONNECT_TIMEOUT && !(_ret = _client.available())) {
-	        //if (!_timeout) Serial.print("\r\nWaiting for response");
-	        //else Serial.print(".");
-	        delay(100);
-	        ++_timeout;
-	    }
-	    //if (_ret) {
-	    //    Serial.print("\r\nResponse Length = ");
-	    //    Serial.println(_ret);
-	    //    while ((_c = _client.read()) != -1)
-		//    Serial.print((char) _c);
-	    //}
-	    //else
-	    //    Serial.println("\r\nNo Response.");
-	    _client.flush();
-	    _client.stop();
-	    return 1;
+    if (!dnsCache.connectFresh(_client, _host, 80))
+        return 0;
+    _timeout = 0;
+    while (_timeout < MAX_CONNECT_TIMEOUT && !_client.connected()) {
+        delay(10);
+        ++_timeout;
+    }
+    _client.write(_message, 5);
+    _timeout = 0;
+    while (_timeout < MAX_CONNECT_TIMEOUT && !(_ret = _client.available())) {
+        delay(100);
+        ++_timeout;
+    }
+    if (_ret)
+        trace(TR_FIRST_BYTE, _ret);
+    _client.flush();
+    _client.stop();
+    return 1;
+}
+
+/*
+ *  One connect to the test server for each soak cycle
+ */
+bool soakTest() {
+    return connectHttpServerHost("data.sparkfun.com");
+}
+
+/*
+ *  Connect to the test server, retrying up to MAX_CONNECT_RETRY times
+ */
+bool testDNS(int &_retries) {
+    int _ret;
+    _retries = 0;
+    while (_retries < MAX_CONNECT_RETRY && !(_ret = connectHttpServerHost("data.sparkfun.com")))  {
+        delay(100);
+        ++_retries;
     }
-    return 0;
+    return _ret;
 }
 
+const char *benchHosts[] = { USER_BENCH_HOSTS };
+
+GatedPrint detailOut(serialOut);    // progress and reports, muted in batch mode
+NetTask netTask(detailOut);  // the CC3000 / WiFi / Cloud transition in progress
+DnsBench dnsBench(benchHosts, sizeof(benchHosts) / sizeof(benchHosts[0]), detailOut);
+const char *probeHosts[] = { USER_PROBE_HOSTS };
+Probe probe(probeHosts, sizeof(probeHosts) / sizeof(probeHosts[0]), detailOut);
+DnsWatchdog dnsWatchdog(netTask, serialOut);
+Throughput throughput(detailOut);
+KeepAlive keepAlive("data.sparkfun.com", "/", 80, detailOut);
+Soak soak(detailOut);    // unattended reconnect / power cycle test
+CommandLine commandLine; // console input with type-ahead
+bool bShowMenu = true;   // print the menu on the next pass through loop()
+uint32_t menuSeen;       // NetState generation the menu was last checked against
+uint8_t menuNet;         // the state the menu was drawn for
+bool bBatch = false;     // line commands instead of the menu
+
 void setup() {
     Serial.begin(9600);
     while(!Serial.available()) {
         Serial.println("Press any key to begin");
         delay(1000);
     }
+    netStateBegin();
+    dnsResolver.setUserDNS(userConfig.dnsServer.toIPAddress());
+    throughput.setTarget(USER_HTTP_TARGET);
+    if (Serial.peek() == '>')
+        return;     // straight into batch mode, the key is read by the menu
     Serial.read();  // Clear any key
     dumpIP();
 }
 
-void loop() {
-
-    byte _ans;
-    int _ret;
-    int _timeout = 0;
+// The part of the state that changes what the menu offers
+uint8_t menuState() {
+    return net.powered | net.ready << 1 | net.cloud << 2 | net.dnsBad << 3;
+}
 
-    Serial.println("\r\nEnter");
-    Serial.print("   [0] Print interface status\r\n");
-    Serial.print("   [1] CC3000 ");
-    Serial.print(bWiFiEnable?"Disable":"Enable");
-    Serial.println();
-    if (bWiFiEnable) {
-        Serial.print("   [2] WiFi ");
-        Serial.println(bWiFiConnect?"Disconnect":"Connect");
+void showMenu() {
+    menuNet = menuState();
+    serialOut.beginRender();
+    serialOut.println("\r\nEnter");
+    serialOut.print("   [0] Print interface status\r\n");
+    serialOut.print("   [1] CC3000 ");
+    serialOut.print(net.powered?"Disable":"Enable");
+    serialOut.println();
+    if (net.powered) {
+        serialOut.print("   [2] WiFi ");
+        serialOut.println(net.ready?"Disconnect":"Connect");
 #if defined(EXPERT_MODE)
-        Serial.print("   [3] WiFi Clear Credentials\r\n");
-        Serial.print("   [4] WiFi Set Credentials\r\n");
-        Serial.print("   [5] Set WiFi to DHCP\r\n");
-        Serial.print("   [6] Set WiFi to static IP/DNS\r\n");
+        serialOut.print("   [3] WiFi Clear Credentials\r\n");
+        serialOut.print("   [4] WiFi Set Credentials\r\n");
+        serialOut.print("   [5] Set WiFi to DHCP\r\n");
+        serialOut.print("   [6] Set WiFi to static IP/DNS\r\n");
     }
-    Serial.print("   [7] Cloud ");
-    Serial.print(bCloudConnect?"Disconnect":"Connect");
-    Serial.println();
-    if (bWiFiConnect) {
-        Serial.print("   [8] Test DNS lookup\r\n");
-    	if (!memcmp(badDNS, ip_config.aucDNSServer, sizeof(badDNS)))
-            Serial.print("   [9] Fix DNS\r\n");
+    serialOut.print("   [7] Cloud ");
+    serialOut.print(net.cloud?"Disconnect":"Connect");
+    serialOut.println();
+    if (net.ready) {
+        serialOut.print("   [8] Test DNS lookup\r\n");
+    	if (net.dnsBad)
+            serialOut.print("   [9] Fix DNS\r\n");
 #else
 	}
-    Serial.print("   [3] Cloud ");
-    Serial.print(bCloudConnect?"Disconnect":"Connect");
-    Serial.println();
-    if (bWiFiConnect) {
-        Serial.print("   [4] Test DNS lookup\r\n");
-        if (!memcmp(badDNS, ip_config.aucDNSServer, sizeof(badDNS)))
-            Serial.print("   [5] Fix DNS\r\n");
+    serialOut.print("   [3] Cloud ");
+    serialOut.print(net.cloud?"Disconnect":"Connect");
+    serialOut.println();
+    if (net.ready) {
+        serialOut.print("   [4] Test DNS lookup\r\n");
+        if (net.dnsBad)
+            serialOut.print("   [5] Fix DNS\r\n");
 #endif
+        serialOut.print("   [b] Benchmark DNS lookup\r\n");
+        serialOut.print("   [u] Benchmark UDP DNS lookup\r\n");
+        serialOut.print("   [h] Probe hosts\r\n");
+        serialOut.print("   [g] HTTP GET throughput\r\n");
+        serialOut.print("   [k] Keep-alive test x10\r\n");
     }
+    serialOut.print("   [c] Show DNS cache\r\n");
+    serialOut.print("   [r] UDP resolver ");
+    serialOut.println(dnsCache.resolver()?"Off":"On");
+
+    if (net.powered)
+        serialOut.print("   [s] Soak test WiFi reconnect x100\r\n");
+    serialOut.print("   [p] Soak test CC3000 power cycle x100\r\n");
+    serialOut.print("   [l] Show soak log\r\n");
+    serialOut.print("   [w] DNS watchdog ");
+    serialOut.println(dnsWatchdog.enabled()?"Off":"On");
+    serialOut.print("   [f] DNS fast path ");
+    serialOut.println(dnsCache.fastPath()?"Off":"On");
+    serialOut.print("   [o] Show output stats\r\n");
+    serialOut.print("   [t] Dump trace as CSV  [j] as JSON lines  [x] recording\r\n");
+    serialOut.print("   [>] Batch mode\r\n");
+
+    serialOut.print("   --> ");
+    serialOut.endRender();
+}
+
+/*
+ *  A fresh copy of the network state - ip_config may have changed since the
+ *  top of loop()
+ */
+void netRefresh() {
+    netStatePoll();
+    netStateRead(net);
+}
+
+/*
+ *  Called once when the transition started from the menu has completed
+ */
+void netTaskDone() {
+    netRefresh();
+    if (!bBatch)
+        dumpIP();
+}
+
+/*
+ *  Resolve around a bad DNS server instead of reconnecting at once - the
+ *  watchdog fix becomes the slow background remedy
+ */
+void setFastPath(bool _on) {
+    dnsCache.setFastPath(_on ? &dnsResolver : NULL);
+    dnsWatchdog.setFixDelay(_on ? DNS_WATCHDOG_LAZY : FIX_DNS_BAD_WAIT);
+}
+
+/*
+ *  Called once when a soak run has completed or was stopped
+ */
+void soakDone() {
+    netRefresh();
+    soak.report(detailOut);
+}
+
+void menuSelect(byte _ans) {
+    int _timeout = 0;
 
-    Serial.print("   --> ");
-    while(!Serial.available()) { if (WiFi.ready()) Particle.process(); };
-    _ans = Serial.read();
     switch (_ans) {
         case '0':
-            Serial.println("Print interface status");
+            serialOut.println("Print interface status");
             dumpIP();
             break;
         case '1':
-            Serial.print("CC3000 ");
-            Serial.print(bWiFiEnable?" Disable":" Enable");
-            Serial.print("\r\n\r\nCC3000 - ");
-            if (bWiFiEnable) {
-                Serial.println("disabling");
-            	if (bWiFiConnect) {
-                    WiFi.disconnect();
-                    Serial.print("Waiting for WiFi to disconnect ");
-                    while (_timeout < MAX_WIFI_RETRY && WiFi.ready()) { Serial.print("-"); _timeout++; delay(100); }
-                    while (ip_config.aucDNSServer[3] != 0 || ip_config.aucDNSServer[2] != 0)
-                        { Serial.print("-"); delay(100); }
-                    bCloudConnect = false;
-                    Serial.println();
-            	}
-                WiFi.off();
-                Serial.print("Waiting for CC3000 to turn off ");
-                while (WiFi.ready()) { Serial.print("-"); Particle.process(); delay(100); }
-                while (ip_config.aucDNSServer[3] != 0 || ip_config.aucDNSServer[2] != 0)
-                    { Serial.print("+"); delay(100); }
-                bWiFiEnable = false;
-                bWiFiConnect = false;
-                bCloudConnect = false;
+            serialOut.print("CC3000 ");
+            serialOut.print(net.powered?" Disable":" Enable");
+            serialOut.print("\r\n\r\nCC3000 - ");
+            if (net.powered) {
+                serialOut.println("disabling");
+                netTask.start(NetTask::CC3000_OFF);
             }
             else {
-                Serial.println("enabling");
-                WiFi.on();
-                bWiFiEnable = true;
+                serialOut.println("enabling");
+                netTask.start(NetTask::CC3000_ON);
             }
-            delay(500);
-            dumpIP();
             break;
         case '2':
-            Serial.print("WiFi ");
-            Serial.print(bWiFiConnect?"Disconnect":"Connect");
-            Serial.print("\r\n\r\nWiFi - ");
-            if (bWiFiEnable) {
-                if (bWiFiConnect) {
-                    Serial.println("disconnecting");
-                    WiFi.disconnect();
-                    Serial.print("Waiting for WiFi to disconnect ");
-                    while (_timeout < MAX_WIFI_RETRY && WiFi.ready()) { Serial.print("-"); _timeout++; delay(100); }
-                    while (ip_config.aucDNSServer[3] != 0 || ip_config.aucDNSServer[2] != 0)
-                        { Serial.print("-"); delay(100); }
-                    bCloudConnect = false;
-                    Serial.println();
+            serialOut.print("WiFi ");
+            serialOut.print(net.ready?"Disconnect":"Connect");
+            serialOut.print("\r\n\r\nWiFi - ");
+            if (net.powered) {
+                if (net.ready) {
+                    serialOut.println("disconnecting");
+                    netTask.start(NetTask::WIFI_DISCONNECT);
                 }
                 else {
-                    Serial.println("connecting");
-                    WiFi.connect();
-                    Serial.print("Waiting for WiFi to connect ");
-                    while (_timeout < MAX_WIFI_RETRY && !WiFi.ready()) { Serial.print("+"); _timeout++; delay(100);}
-                    if (_timeout == MAX_WIFI_RETRY) {
-                        Serial.print("Failed to connect to WiFi router - credentials ");
-                        Serial.println(WiFi.hasCredentials() ? "known" : "unknown");
-                    }
-                    else Serial.println();
-                    _timeout = 0;
+                    serialOut.println("connecting");
+                    netTask.start(NetTask::WIFI_CONNECT);
                 }
-                bWiFiConnect = WiFi.ready();
-                delay(500);
-                dumpIP();
             } else
-                Serial.println("Error - CC3000 must be enabled");
+                serialOut.println("Error - CC3000 must be enabled");
             break;
 #if defined(EXPERT_MODE)
         case '3':
-            if (bWiFiEnable) {
-                Serial.println("Clearing WiFi Credentials");
+            if (net.powered) {
+                serialOut.println("Clearing WiFi Credentials");
                 WiFi.clearCredentials();
                 dumpIP();
             } else
-                Serial.println("Error - CC3000 must be enabled");
+                serialOut.println("Error - CC3000 must be enabled");
             break;
         case '4':
-            if (bWiFiEnable) {
-                Serial.println("Setting WiFi Credentials");
+            if (net.powered) {
+                serialOut.println("Setting WiFi Credentials");
                 WiFi.setCredentials(USER_WIFI_SSID, USER_WIFI_PASSWORD);
                 dumpIP();
             } else
-                Serial.println("Error - CC3000 must be enabled");
+                serialOut.println("Error - CC3000 must be enabled");
             break;
         case '5':
-            if (bWiFiEnable) {
-                Serial.println("Setting WiFi to DHCP\r\n");
+            if (net.powered) {
+                serialOut.println("Setting WiFi to DHCP\r\n");
+                if (netProfileMatches(IPV4_DHCP))
+                    serialOut.println("CC3000 already set to DHCP - no restart");
                 setDHCP();
-                delay(500);
-                dumpIP();
+                netTask.start(NetTask::SETTLE);
             } else
-                Serial.println("Error - CC3000 must be enabled");
+                serialOut.println("Error - CC3000 must be enabled");
             break;
         case '6':
-            if (bWiFiEnable) {
-                Serial.println("Setting WiFi to static IP/DNS\r\n");
+            if (net.powered) {
+                serialOut.println("Setting WiFi to static IP/DNS\r\n");
+                if (netProfileMatches(userConfig))
+                    serialOut.println("CC3000 already set to this static IP/DNS - no restart");
                 setDNSIP();
-                delay(500);
-                dumpIP();
+                netTask.start(NetTask::SETTLE);
             } else
-                Serial.println("Error - CC3000 must be enabled");
+                serialOut.println("Error - CC3000 must be enabled");
             break;
         case '7':
 #else
         case '3':
 #endif
-        	Serial.print("Cloud ");
-            Serial.print(bCloudConnect?"Disconnect":"Connect");
-            Serial.print("\r\n\r\nCloud - ");
-            if (bCloudConnect) {
-                Serial.print("disconnecting -");
-                Particle.disconnect();
-                _timeout = 0;
-                while (_timeout < MAX_WIFI_RETRY && Particle.connected()) { Serial.print("-"); _timeout++; delay(100);}
-                if (_timeout == MAX_WIFI_RETRY) {
-                    Serial.println("Failed to disconnect from cloud");
-                }
-                else Serial.println();
+        	serialOut.print("Cloud ");
+            serialOut.print(net.cloud?"Disconnect":"Connect");
+            serialOut.print("\r\n\r\nCloud - ");
+            if (net.cloud) {
+                serialOut.print("disconnecting -");
+                netTask.start(NetTask::CLOUD_DISCONNECT);
             } else {
-            	Serial.print("connecting +");
-            	Particle.connect();
-            	_timeout = 0;
-            	while (_timeout < MAX_WIFI_RETRY && !Particle.connected()) { Serial.print("+"); _timeout++; delay(100);}
-            	if (_timeout == MAX_WIFI_RETRY) {
-            		Serial.println("Failed to connect to Spark Cloud.");
-            	}
-                else {
-                	Serial.println();
-                	bWiFiEnable = true;
-                	bWiFiConnect = WiFi.ready();
-                }
+            	serialOut.print("connecting +");
+                netTask.start(NetTask::CLOUD_CONNECT);
             }
-            bCloudConnect = Particle.connected();
-            dumpIP();
             break;
 #if defined(EXPERT_MODE)
         case '8':
 #else
         case '4':
 #endif
-            Serial.println("Test DNS\r\n\r\nConnect to data.sparkfun.com - ");
-            if (bWiFiEnable && bWiFiConnect) {
-                while (_timeout < MAX_CONNECT_RETRY && !(_ret = connectHttpServerHost("data.sparkfun.com")))  {
-                    delay(100);
-                    ++_timeout;
-                }
-                if (_ret)
-                    Serial.print("Connect successful! ");
+            serialOut.println("Test DNS\r\n\r\nConnect to data.sparkfun.com - ");
+            serialOut.flush();      // the test blocks
+            if (net.powered && net.ready) {
+                if (testDNS(_timeout))
+                    serialOut.print("Connect successful! ");
                 else
-                    Serial.print("Connect unsuccessful. ");
+                    serialOut.print("Connect unsuccessful. ");
 
                 if (_timeout > 0) {
-                    Serial.print("[ ");
-                    Serial.print(_timeout);
+                    serialOut.print("[ ");
+                    serialOut.print(_timeout);
                     if (_timeout > 1)
-                        Serial.print("retries]");
+                        serialOut.print("retries]");
                     else
-                        Serial.print("retry]");
+                        serialOut.print("retry]");
                 }
-                Serial.println();
+                serialOut.println();
             } else
-                Serial.println("Error - CC3000 must be enabled and WiFi connected");
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
             break;
 #if defined(EXPERT_MODE)
         case '9':
 #else
         case '5':
 #endif
-            Serial.println("Fix DNS\r\n\r\nFixing DNS IP -");
-            if (bWiFiConnect) {
-                if (!memcmp(badDNS, ip_config.aucDNSServer, sizeof(badDNS))) {
-                    fixDNS();
-            	    dumpIP();
-                }
+            serialOut.println("Fix DNS\r\n\r\nFixing DNS IP -");
+            if (net.ready) {
+                if (net.dnsBad)
+                    netTask.start(NetTask::FIX_DNS);
                 else
-                    Serial.println("Error - CC3000 DNS must be 76.83.0.0");
+                    serialOut.println("Error - CC3000 DNS must be 76.83.0.0");
+            }
+            else
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
+            break;
+        case 'b':
+            serialOut.println("Benchmark DNS lookup\r\n");
+            if (net.ready)
+                dnsBench.start();
+            else
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
+            break;
+        case 'c':
+            serialOut.println("Show DNS cache\r\n");
+            dnsCache.print(serialOut);
+            break;
+        case 'r':
+            serialOut.print("UDP resolver ");
+            if (dnsCache.resolver()) {
+                serialOut.println("Off\r\n\r\nLookups use the CC3000 resolver");
+                dnsCache.setResolver(NULL);
+            } else {
+                serialOut.println("On\r\n\r\nLookups race the DHCP DNS, gateway and USER_DNS over UDP");
+                dnsCache.setResolver(&dnsResolver);
+            }
+            dnsCache.clear();
+            break;
+        case 'o':
+            serialOut.println("Show output stats\r\n");
+            serialOut.printStats(serialOut);
+            break;
+        case 't':
+            serialOut.println("Dump trace as CSV\r\n");
+            traceDumpCsv(serialOut);
+            break;
+        case 'j':
+            serialOut.println("Dump trace as JSON lines\r\n");
+            traceDumpJson(serialOut);
+            break;
+        case 'x':
+            serialOut.println("Dump network recording\r\n");
+            traceDumpBinary(serialOut);
+            break;
+        case '>':
+            serialOut.println("Batch mode - commands separated by ; or new lines, \"menu\" to return");
+            bBatch = true;
+            detailOut.mute(true);
+            break;
+        case 's':
+            serialOut.println("Soak test WiFi reconnect\r\n");
+            if (net.powered)
+                soak.start(Soak::WIFI, SOAK_CYCLES, soakTest);
+            else
+                serialOut.println("Error - CC3000 must be enabled");
+            break;
+        case 'p':
+            serialOut.println("Soak test CC3000 power cycle\r\n");
+            soak.start(Soak::POWER, SOAK_CYCLES, soakTest);
+            break;
+        case 'h':
+            serialOut.println("Probe hosts\r\n");
+            if (net.ready)
+                probe.start(&dnsCache);
+            else
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
+            break;
+        case 'g':
+            serialOut.println("HTTP GET throughput\r\n");
+            if (net.ready)
+                throughput.start(&dnsCache);
+            else
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
+            break;
+        case 'k':
+            serialOut.println("Keep-alive test\r\n");
+            if (net.ready)
+                keepAlive.start(KEEPALIVE_REQUESTS, &dnsCache);
+            else
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
+            break;
+        case 'w':
+            serialOut.print("DNS watchdog ");
+            serialOut.println(dnsWatchdog.enabled()?"Off\r\n":"On\r\n");
+            dnsWatchdog.enable(!dnsWatchdog.enabled());
+            dnsWatchdog.printStats(serialOut);
+            break;
+        case 'f':
+            serialOut.print("DNS fast path ");
+            if (dnsCache.fastPath()) {
+                serialOut.println("Off\r\n\r\nA bad DNS server waits for Fix DNS");
+                setFastPath(false);
+            } else {
+                serialOut.println("On\r\n\r\nWith a bad DNS server lookups go to the gateway and USER_DNS");
+                setFastPath(true);
             }
+            break;
+        case 'l':
+            serialOut.println("Show soak log\r\n");
+            soak.printLog(serialOut);
+            break;
+        case 'u':
+            serialOut.println("Benchmark UDP DNS lookup\r\n");
+            if (net.ready)
+                dnsBench.start(DNS_BENCH_LOOKUPS, &dnsResolver);
             else
-                Serial.println("Error - CC3000 must be enabled and WiFi connected");
+                serialOut.println("Error - CC3000 must be enabled and WiFi connected");
             break;
         default:
-            Serial.println("Invalid selection.");
+            serialOut.println("Invalid selection.");
             break;
     }
+}
+
+/*
+ *  Batch mode
+ *
+ *  Commands come from the receive ring, separated by ';' or a line end, and
+ *  run back to back; "xN" after a command repeats it N times.  Progress
+ *  output and the menu are suppressed, each command prints one status line
+ *  when it completes -
+ *      ok connect 3852ms
+ *      fail test 98/100 21023ms
+ *  err means the command could not run in the current state; a command too
+ *  long for COMMAND_MAX or with a repeat count outside 1..65535 fails
+ *  without running.
+ */
+struct BatchCommand {
+    char name[COMMAND_MAX + 1];     // the repeat count removed, lower case
+    const char *arg;                // second word, "" if none
+    uint16_t repeat;
+    uint16_t done;
+    uint16_t failed;
+    uint32_t start;
+    bool running;
+} batch;
+
+// Status line up to the elapsed time, the caller ends the line
+void batchReport(const char *_result) {
+    serialOut.print(_result);
+    serialOut.print(' ');
+    serialOut.print(batch.name);
+    if (*batch.arg) {
+        serialOut.print(' ');
+        serialOut.print(batch.arg);
+    }
+    if (batch.repeat > 1) {
+        serialOut.print(' ');
+        serialOut.print(batch.done - batch.failed);
+        serialOut.print('/');
+        serialOut.print(batch.repeat);
+    }
+    serialOut.print(' ');
+    serialOut.print(millis() - batch.start);
+    serialOut.print("ms");
+    batch.running = false;
+}
 
+void batchError(const char *_why) {
+    batchReport("err");
+    serialOut.print(' ');
+    serialOut.println(_why);
+}
+
+// A status line for a command that never ran
+void batchReject(const char *_name, const char *_why) {
+    if (_name != batch.name) {
+        strncpy(batch.name, _name, COMMAND_MAX);
+        batch.name[COMMAND_MAX] = 0;
+    }
+    batch.arg = "";
+    batch.repeat = 1;
+    batch.start = millis();
+    batchReport("fail");
+    serialOut.print(' ');
+    serialOut.println(_why);
+}
+
+bool batchParse(char *_line) {
+    uint8_t _n = 0;
+    bool _badRepeat = false;
+    for (char *_p = _line; *_p; _p++)
+        if (*_p >= 'A' && *_p <= 'Z')
+            *_p += 'a' - 'A';
+
+    batch.repeat = 1;
+    batch.arg = "";
+    char *_word = strtok(_line, " ");
+    while (_word) {
+        if (_word[0] == 'x' && ((_word[1] >= '0' && _word[1] <= '9') || _word[1] == '-' || _word[1] == '+')) {
+            char *_end;
+            unsigned long _repeat = strtoul(_word + 1, &_end, 10);
+            if (*_end || _word[1] == '-' || !_repeat || _repeat > 65535)
+                _badRepeat = true;
+            else
+                batch.repeat = _repeat;
+        } else if (!_n++)
+            strcpy(batch.name, _word);
+        else if (_n == 2)
+            batch.arg = _word;  // points into the line, copied below
+        _word = strtok(NULL, " ");
+    }
+    if (!_n)
+        return false;
+    if (_badRepeat) {
+        batchReject(batch.name, "bad repeat count");
+        return false;
+    }
+    // keep the argument after the name
+    if (*batch.arg) {
+        uint8_t _len = strlen(batch.name);
+        strcpy(batch.name + _len + 1, batch.arg);
+        batch.arg = batch.name + _len + 1;
+    }
+    batch.done = 0;
+    batch.failed = 0;
+    batch.start = millis();
+    batch.running = true;
+    return true;
+}
+
+// One repetition done, the status line after the last
+void batchResult(bool _ok) {
+    batch.done++;
+    if (!_ok)
+        batch.failed++;
+    if (batch.done < batch.repeat)
+        return;
+    batchReport(batch.failed ? "fail" : "ok");
+    serialOut.println();
+}
+
+void batchBenchDone() {
+    const Histogram &_h = dnsBench.histogram();
+    batchReport(dnsBench.failures() ? "fail" : "ok");
+    serialOut.print(' ');
+    serialOut.print(_h.count());
+    serialOut.print(" ok ");
+    serialOut.print(dnsBench.failures());
+    serialOut.print(" failed p50 ");
+    printMs(serialOut, _h.percentile(50));
+    serialOut.print(" p99 ");
+    printMs(serialOut, _h.percentile(99));
+    serialOut.println("ms");
+}
+
+void batchProbeDone() {
+    batchReport(probe.failures() ? "fail" : "ok");
+    serialOut.print(' ');
+    serialOut.print(sizeof(probeHosts) / sizeof(probeHosts[0]) - probe.failures());
+    serialOut.print('/');
+    serialOut.print(sizeof(probeHosts) / sizeof(probeHosts[0]));
+    serialOut.println(" hosts");
+}
+
+// One GET done, the status line with the last one's numbers after the last
+void batchHttpDone() {
+    batch.done++;
+    if (!throughput.succeeded())
+        batch.failed++;
+    if (batch.done < batch.repeat)
+        return;
+    uint32_t _rate = throughput.rate();
+    batchReport(batch.failed ? "fail" : "ok");
+    serialOut.print(" status ");
+    serialOut.print(throughput.status());
+    serialOut.print(" ttfb ");
+    serialOut.print(throughput.firstByteMs());
+    serialOut.print("ms body ");
+    serialOut.print(throughput.bodyBytes());
+    serialOut.print(' ');
+    serialOut.print(_rate / 1024);
+    serialOut.print('.');
+    serialOut.print((_rate % 1024) * 10 / 1024);
+    serialOut.println("KB/s");
+}
+
+void batchKeepAliveDone() {
+    batchReport(keepAlive.failures() ? "fail" : "ok");
+    serialOut.print(' ');
+    serialOut.print(keepAlive.requests() - keepAlive.failures());
+    serialOut.print('/');
+    serialOut.print(keepAlive.requests());
+    serialOut.print(" new ");
+    serialOut.print(keepAlive.newAvgMs());
+    serialOut.print("ms reused ");
+    serialOut.print(keepAlive.reusedAvgMs());
+    serialOut.print("ms reopened ");
+    serialOut.println(keepAlive.reopened());
+}
+
+void batchSoakDone() {
+    batchReport(soak.failures() ? "fail" : "ok");
+    serialOut.print(' ');
+    serialOut.print(soak.done());
+    serialOut.print(" cycles ");
+    serialOut.print(soak.noLink());
+    serialOut.print(" no link ");
+    serialOut.print(soak.noDns());
+    serialOut.print(" no dns ");
+    serialOut.print(soak.badDns());
+    serialOut.print(" bad dns ");
+    serialOut.print(soak.testFailed());
+    serialOut.println(" test failed");
+}
+
+void batchStatus() {
+    batchReport("ok");
+    serialOut.print(" cc3000 ");
+    serialOut.print(net.powered);
+    serialOut.print(" wifi ");
+    serialOut.print(net.ready);
+    serialOut.print(" cloud ");
+    serialOut.print(net.cloud);
+    if (net.ready) {
+        char _str[16];
+        formatIPv4(_str, net.ip);
+        serialOut.print(" ip ");
+        serialOut.print(_str);
+        formatIPv4(_str, net.dns);
+        serialOut.print(" dns ");
+        serialOut.print(_str);
+        serialOut.print(" rssi ");
+        serialOut.print(WiFi.RSSI());
+    }
+    serialOut.println();
+}
+
+// The IP settings last written to the CC3000, as remembered in EEPROM
+void batchProfile() {
+    NetProfile _p;
+    bool _saved = loadNetProfile(_p);
+    batchReport("ok");
+    if (!_saved)
+        serialOut.println(" none");
+    else if (_p.dhcp)
+        serialOut.println(" dhcp");
+    else {
+        const IPv4 *_a[] = { &_p.config.ip, &_p.config.subnetMask, &_p.config.defaultGateway, &_p.config.dnsServer };
+        const char *_label[] = { " static ip ", " mask ", " gw ", " dns " };
+        char _str[16];
+        for (uint8_t i = 0; i < 4; i++) {
+            formatIPv4(_str, *_a[i]);
+            serialOut.print(_label[i]);
+            serialOut.print(_str);
+        }
+        serialOut.println();
+    }
+}
+
+void batchHelp() {
+    serialOut.println("on off connect disconnect cloud [off] fixdns test status dump");
+    serialOut.println("bench [udp] udp on|off cache trace csv|json|bin stats verbose on|off menu");
+    serialOut.println("watchdog on|off fastpath on|off probe http [host[:port]/path] keepalive [close] soak [power] soak log|report");
+    serialOut.println("profile [clear]");
+#if defined(EXPERT_MODE)
+    serialOut.println("dhcp static");
+#endif
+    serialOut.println("xN after a command repeats it, bench xN runs N lookups, keepalive xN N requests,");
+    serialOut.println("soak xN N cycles");
+}
+
+// Start one repetition of the current command
+void batchStep() {
+    const char *_n = batch.name;
+    bool _on = strcmp(batch.arg, "off") != 0;
+    int _retries;
+
+    if (!strcmp(_n, "on")) {
+        if (net.powered)
+            batchResult(true);
+        else
+            netTask.start(NetTask::CC3000_ON);
+    } else if (!strcmp(_n, "off")) {
+        if (!net.powered)
+            batchResult(true);
+        else
+            netTask.start(NetTask::CC3000_OFF);
+    } else if (!strcmp(_n, "connect")) {
+        if (!net.powered)
+            batchError("cc3000 off");
+        else if (net.ready)
+            batchResult(true);
+        else
+            netTask.start(NetTask::WIFI_CONNECT);
+    } else if (!strcmp(_n, "disconnect")) {
+        if (!net.ready)
+            batchResult(true);
+        else
+            netTask.start(NetTask::WIFI_DISCONNECT);
+    } else if (!strcmp(_n, "cloud")) {
+        if (net.cloud == _on)
+            batchResult(true);
+        else
+            netTask.start(_on ? NetTask::CLOUD_CONNECT : NetTask::CLOUD_DISCONNECT);
+    } else if (!strcmp(_n, "fixdns")) {
+        if (!net.ready)
+            batchError("wifi not connected");
+        else if (!dnsIsBad())
+            batchResult(true);
+        else
+            netTask.start(NetTask::FIX_DNS);
+    } else if (!strcmp(_n, "test")) {
+        if (!net.ready)
+            batchError("wifi not connected");
+        else
+            batchResult(testDNS(_retries));
+    } else if (!strcmp(_n, "bench")) {
+        if (!net.ready)
+            batchError("wifi not connected");
+        else {
+            // the repeat count is the number of lookups
+            dnsBench.start(batch.repeat > 1 ? batch.repeat : DNS_BENCH_LOOKUPS,
+                strcmp(batch.arg, "udp") ? NULL : &dnsResolver);
+            batch.repeat = 1;
+        }
+    } else if (!strcmp(_n, "probe")) {
+        if (!net.ready)
+            batchError("wifi not connected");
+        else
+            probe.start(&dnsCache);
+    } else if (!strcmp(_n, "http")) {
+        if (!net.ready)
+            batchError("wifi not connected");
+        else if (*batch.arg && !throughput.setTarget(batch.arg))
+            batchError("bad target");
+        else if (!throughput.start(&dnsCache))
+            batchHttpDone();
+    } else if (!strcmp(_n, "keepalive")) {
+        if (!strcmp(batch.arg, "close")) {
+            keepAlive.close();
+            batchResult(true);
+        } else if (!net.ready)
+            batchError("wifi not connected");
+        else {
+            // the repeat count is the number of requests
+            keepAlive.start(batch.repeat > 1 ? batch.repeat : KEEPALIVE_REQUESTS, &dnsCache);
+            batch.repeat = 1;
+        }
+    } else if (!strcmp(_n, "soak")) {
+        if (!strcmp(batch.arg, "log")) {
+            soak.printLog(serialOut);
+            batchResult(true);
+        } else if (!strcmp(batch.arg, "report")) {
+            soak.report(serialOut);
+            batchResult(true);
+        } else if (strcmp(batch.arg, "power") && !net.powered)
+            batchError("cc3000 off");
+        else {
+            // the repeat count is the number of cycles
+            soak.start(strcmp(batch.arg, "power") ? Soak::WIFI : Soak::POWER,
+                batch.repeat > 1 ? batch.repeat : SOAK_CYCLES, soakTest);
+            batch.repeat = 1;
+        }
+    } else if (!strcmp(_n, "status"))
+        batchStatus();
+    else if (!strcmp(_n, "dump")) {
+        dumpIP();
+        batchResult(true);
+    } else if (!strcmp(_n, "udp")) {
+        dnsCache.setResolver(_on ? &dnsResolver : NULL);
+        dnsCache.clear();
+        batchResult(true);
+    } else if (!strcmp(_n, "profile")) {
+        // clear when NVMEM no longer holds what EEPROM says, the next
+        // dhcp / static / Fix DNS then writes it again
+        if (!strcmp(batch.arg, "clear")) {
+            forgetNetProfile();
+            batchResult(true);
+        } else
+            batchProfile();
+    } else if (!strcmp(_n, "cache")) {
+        dnsCache.print(serialOut);
+        batchResult(true);
+    } else if (!strcmp(_n, "trace")) {
+        if (!strcmp(batch.arg, "json"))
+            traceDumpJson(serialOut);
+        else if (!strcmp(batch.arg, "bin"))
+            traceDumpBinary(serialOut);
+        else
+            traceDumpCsv(serialOut);
+        batchResult(true);
+    } else if (!strcmp(_n, "stats")) {
+        serialOut.printStats(serialOut);
+        netTask.printFixStats(serialOut);
+        dnsWatchdog.printStats(serialOut);
+        batchResult(true);
+    } else if (!strcmp(_n, "watchdog")) {
+        dnsWatchdog.enable(_on);
+        batchResult(true);
+    } else if (!strcmp(_n, "fastpath")) {
+        setFastPath(_on);
+        batchResult(true);
+    } else if (!strcmp(_n, "verbose")) {
+        detailOut.mute(!_on);
+        batchResult(true);
+    } else if (!strcmp(_n, "menu")) {
+        bBatch = false;
+        detailOut.mute(false);
+        bShowMenu = true;
+        batchResult(true);
+    } else if (!strcmp(_n, "help")) {
+        batchHelp();
+        batchResult(true);
+#if defined(EXPERT_MODE)
+    } else if (!strcmp(_n, "dhcp") || !strcmp(_n, "static")) {
+        if (!net.powered)
+            batchError("cc3000 off");
+        else {
+            if (!strcmp(_n, "dhcp"))
+                setDHCP();
+            else
+                setDNSIP();
+            netTask.start(NetTask::SETTLE);
+        }
+#endif
+    } else
+        batchError("unknown command");
+}
+
+void batchRun() {
+    char _line[COMMAND_MAX + 1];
+
+    if (batch.running)
+        batchStep();
+    else switch (commandLine.next(_line, sizeof(_line))) {
+        case CommandLine::COMMAND:
+            if (batchParse(_line))
+                batchStep();
+            break;
+        case CommandLine::TOO_LONG:
+            batchReject(_line, "too long");
+            break;
+        case CommandLine::NONE:
+            break;
+    }
+}
+
+void loop() {
+
+    serialOut.service();
+    netRefresh();
+    traceWatch();
+    commandLine.poll();
+
+    if (net.ready)
+        Particle.process();
+
+    // A transition is running - advance it, the status stays available with [0]
+    if (netTask.busy()) {
+        if (netTask.run()) {
+            if (dnsWatchdog.fixing()) {
+                // not asked for - no status line, the batch carries on
+                dnsWatchdog.fixDone(netTask.succeeded());
+                bShowMenu = !bBatch;
+                return;
+            }
+            netTaskDone();
+            if (bBatch)
+                batchResult(netTask.succeeded());
+            else
+                bShowMenu = true;
+        }
+        else if (!bBatch && commandLine.peek() == '0') {
+            commandLine.read();
+            dumpIP();
+        }
+        return;
+    }
+
+    if (dnsBench.busy()) {
+        if (dnsBench.run()) {
+            if (bBatch)
+                batchBenchDone();
+            else
+                bShowMenu = true;
+        }
+        return;
+    }
+
+    if (probe.busy()) {
+        if (probe.run()) {
+            if (bBatch)
+                batchProbeDone();
+            else
+                bShowMenu = true;
+        }
+        return;
+    }
+
+    if (throughput.busy()) {
+        if (throughput.run()) {
+            if (bBatch)
+                batchHttpDone();
+            else
+                bShowMenu = true;
+        }
+        return;
+    }
+
+    if (keepAlive.busy()) {
+        if (keepAlive.run()) {
+            if (bBatch)
+                batchKeepAliveDone();
+            else
+                bShowMenu = true;
+        }
+        return;
+    }
+
+    // any key stops a soak run from the menu, batch commands wait for it
+    if (soak.busy()) {
+        bool _stop = !bBatch && commandLine.available();
+        if (_stop) {
+            commandLine.read();
+            soak.stop();
+        }
+        if (soak.run() || _stop) {
+            soakDone();
+            if (bBatch)
+                batchSoakDone();
+            else
+                bShowMenu = true;
+        }
+        return;
+    }
+
+    // only with nothing else running, a fix it starts runs on the NetTask
+    if (dnsWatchdog.run())
+        return;
+
+    if (bBatch) {
+        batchRun();
+        return;
+    }
+
+    // the state changed under the menu - a dropped link or cloud, a bad DNS
+    if (netStateChanged(menuSeen) && menuState() != menuNet)
+        bShowMenu = true;
+
+    // no redraw while keys are typed ahead
+    if (bShowMenu && !commandLine.available()) {
+        showMenu();
+        bShowMenu = false;
+    }
+
+    if (commandLine.available()) {
+        menuSelect(commandLine.read());
+        bShowMenu = !bBatch && !netTask.busy() && !dnsBench.busy() && !probe.busy() && !throughput.busy() && !keepAlive.busy() && !soak.busy();
+    }
 }
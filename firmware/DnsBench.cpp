@@ -0,0 +1,106 @@
+/*
+ *  DnsBench.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "DnsBench.h"
+
+DnsBench::DnsBench(const char * const *hosts, uint8_t count, Print &out)
+    : _out(out), _hosts(hosts), _resolver(NULL), _hostCount(count < DNS_BENCH_MAX_HOSTS ? count : DNS_BENCH_MAX_HOSTS),
+      _lookups(0), _remaining(0), _failures(0), _failedUs(0)
+{
+}
+
+bool DnsBench::start(uint16_t lookups, DnsResolver *resolver)
+{
+    if (busy() || !lookups || !_hostCount)
+        return false;
+    _resolver = resolver;
+    _lookups = lookups;
+    _remaining = lookups;
+    _failures = 0;
+    _failedUs = 0;
+    memset(_ok, 0, sizeof(_ok));
+    memset(_fail, 0, sizeof(_fail));
+    _hist.clear();
+    _out.print(_resolver ? "UDP DNS benchmark - " : "DNS benchmark - ");
+    _out.print(lookups);
+    _out.print(" lookups over ");
+    _out.print(_hostCount);
+    _out.println(" hosts");
+    return true;
+}
+
+bool DnsBench::run()
+{
+    if (!busy())
+        return false;
+    if (!WiFi.ready()) {
+        _out.println("\r\nError - WiFi disconnected, benchmark stopped");
+        _remaining = 0;
+        report();
+        return true;
+    }
+
+    uint16_t _n = _lookups - _remaining;
+    uint8_t _h = _n % _hostCount;
+    uint32_t _start = micros();
+    IPAddress _ip = lookup(_hosts[_h]);
+    uint32_t _us = micros() - _start;
+
+    if ((uint32_t) _ip) {
+        _hist.add(_us);
+        _ok[_h]++;
+        _out.print('.');
+    } else {
+        _failures++;
+        _failedUs += _us;
+        _fail[_h]++;
+        _out.print('x');
+    }
+    if (++_n % 50 == 0)
+        _out.println();
+
+    if (--_remaining)
+        return false;
+    report();
+    return true;
+}
+
+IPAddress DnsBench::lookup(const char *host)
+{
+    if (!_resolver)
+        return WiFi.resolve(host);
+    IPAddress _ip;
+    uint32_t _ttl;
+    _resolver->resolve(host, _ip, _ttl);
+    return _ip;
+}
+
+void DnsBench::report()
+{
+    _out.println();
+    for (uint8_t i = 0; i < _hostCount; i++) {
+        _out.print("   ");
+        _out.print(_hosts[i]);
+        _out.print("  ok ");
+        _out.print(_ok[i]);
+        _out.print("  failed ");
+        _out.println(_fail[i]);
+    }
+    _out.print("Resolve ");
+    _out.print(_hist.count());
+    _out.print(": ");
+    _hist.printMs(_out);
+    if (_failures) {
+        _out.print("Failed ");
+        _out.print(_failures);
+        _out.print(", ");
+        printMs(_out, _failedUs);
+        _out.println(" ms spent in failed lookups");
+    }
+    if (_resolver)
+        _resolver->print(_out);
+}
@@ -0,0 +1,56 @@
+/*
+ *  DnsBench.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  DNS resolution latency benchmark.
+ *
+ *  Runs back-to-back lookups through the CC3000 resolver, cycling through a
+ *  list of host names, one lookup per pass through loop().  Only the name
+ *  resolution is timed - no TCP connection is made - and the successful
+ *  lookups go into a Histogram reported as min/p50/p95/p99/max.
+ *
+ *  Started with a DnsResolver the lookups go over UDP instead and the
+ *  per-server answers and wins are reported as well.
+ */
+
+#ifndef DNSBENCH_H_
+#define DNSBENCH_H_
+
+#include <application.h>
+#include "Histogram.h"
+#include "DnsResolver.h"
+
+#define DNS_BENCH_LOOKUPS   100     // lookups per benchmark run
+#define DNS_BENCH_MAX_HOSTS 8
+
+class DnsBench {
+public:
+    DnsBench(const char * const *hosts, uint8_t count, Print &out = Serial);
+
+    bool start(uint16_t lookups = DNS_BENCH_LOOKUPS, DnsResolver *resolver = NULL);
+    bool run();                         // true once, when the run completes
+    bool busy() const { return _remaining != 0; }
+    void stop() { _remaining = 0; }
+    const Histogram &histogram() const { return _hist; }
+    uint16_t failures() const { return _failures; }
+
+private:
+    void report();
+    IPAddress lookup(const char *host);
+
+    Print &_out;
+    const char * const *_hosts;
+    DnsResolver *_resolver;
+    uint8_t _hostCount;
+    uint16_t _lookups;
+    uint16_t _remaining;
+    uint16_t _failures;
+    uint32_t _failedUs;
+    uint16_t _ok[DNS_BENCH_MAX_HOSTS];
+    uint16_t _fail[DNS_BENCH_MAX_HOSTS];
+    Histogram _hist;
+};
+
+#endif /* DNSBENCH_H_ */
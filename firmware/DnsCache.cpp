@@ -0,0 +1,270 @@
+/*
+ *  DnsCache.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "DnsCache.h"
+#include "NetTask.h"
+#include "SerialOut.h"
+#include "Trace.h"
+
+void DnsCache::clear()
+{
+    memset(_slot, 0, sizeof(_slot));
+    _hits = 0;
+    _misses = 0;
+    _negativeHits = 0;
+    _staleHits = 0;
+    _fastPathLookups = 0;
+}
+
+// FNV-1a over the lower-cased name
+uint32_t DnsCache::hashName(const char *host)
+{
+    uint32_t _h = 2166136261UL;
+    while (*host) {
+        char _c = *host++;
+        if (_c >= 'A' && _c <= 'Z')
+            _c += 'a' - 'A';
+        _h = (_h ^ (uint8_t) _c) * 16777619UL;
+    }
+    return _h;
+}
+
+bool DnsCache::expired(const Entry &e, uint32_t now)
+{
+    return (int32_t) (e.expires - now) <= 0;
+}
+
+DnsCache::Entry *DnsCache::find(const char *host, uint32_t hash)
+{
+    for (uint8_t i = 0; i < DNS_CACHE_SLOTS; i++) {
+        Entry &_e = _slot[(hash + i) & (DNS_CACHE_SLOTS - 1)];
+        if (_e.state == EMPTY)
+            return NULL;
+        if (_e.hash == hash && !strcasecmp(_e.name, host))
+            return &_e;
+    }
+    return NULL;
+}
+
+DnsCache::Entry *DnsCache::slotFor(const char *host, uint32_t hash)
+{
+    Entry *_e = find(host, hash);
+    if (_e)
+        return _e;
+
+    // First free slot in the probe sequence, an expired slot that is no use
+    // as a fallback, or - table full - the entry closest to expiring.
+    uint32_t _now = millis();
+    Entry *_reuse = NULL;
+    Entry *_oldest = NULL;
+    int32_t _oldestLeft = 0x7FFFFFFF;
+    for (uint8_t i = 0; i < DNS_CACHE_SLOTS; i++) {
+        _e = &_slot[(hash + i) & (DNS_CACHE_SLOTS - 1)];
+        if (_e->state == EMPTY)
+            return _reuse ? _reuse : _e;
+        int32_t _left = (int32_t) (_e->expires - _now);
+        if (!_reuse && _left <= 0 && (_e->state == NEGATIVE_ENTRY || -_left > DNS_CACHE_STALE_MAX * 1000L))
+            _reuse = _e;
+        if (_left < _oldestLeft) {
+            _oldestLeft = _left;
+            _oldest = _e;
+        }
+    }
+    return _reuse ? _reuse : _oldest;
+}
+
+void DnsCache::store(const char *host, uint8_t state, const uint8_t *ip, uint32_t ttl)
+{
+    if (strlen(host) > DNS_CACHE_NAME_MAX)
+        return;
+    if (ttl > DNS_CACHE_MAX_TTL)
+        ttl = DNS_CACHE_MAX_TTL;
+
+    uint32_t _hash = hashName(host);
+    Entry *_e = slotFor(host, _hash);
+    _e->hash = _hash;
+    _e->state = state;
+    _e->expires = millis() + ttl * 1000;
+    if (ip)
+        memcpy(_e->ip, ip, 4);
+    else
+        memset(_e->ip, 0, 4);
+    strcpy(_e->name, host);
+}
+
+void DnsCache::put(const char *host, IPAddress ip, uint32_t ttl)
+{
+    uint8_t _ip[4] = { ip[0], ip[1], ip[2], ip[3] };
+    store(host, POSITIVE, _ip, ttl);
+}
+
+void DnsCache::putNegative(const char *host, uint32_t ttl)
+{
+    store(host, NEGATIVE_ENTRY, NULL, ttl);
+}
+
+DnsCache::Result DnsCache::lookup(const char *host, IPAddress &ip)
+{
+    Entry *_e = find(host, hashName(host));
+    if (!_e || expired(*_e, millis())) {
+        _misses++;
+        return MISS;
+    }
+    if (_e->state == NEGATIVE_ENTRY) {
+        _negativeHits++;
+        return NEGATIVE;
+    }
+    _hits++;
+    ip = IPAddress(_e->ip[0], _e->ip[1], _e->ip[2], _e->ip[3]);
+    return HIT;
+}
+
+IPAddress DnsCache::resolve(const char *host)
+{
+    bool _cached;
+    return resolve(host, _cached);
+}
+
+IPAddress DnsCache::resolve(const char *host, bool &cached)
+{
+    IPAddress _ip;
+    cached = true;
+    Result _r = lookup(host, _ip);
+    if (_r == HIT)
+        return _ip;
+    // negative entries from the bad server's timeouts do not hold up the fast path
+    bool _fast = !_resolver && _fastPath && dnsIsBad();
+    if (_r == NEGATIVE && !_fast)
+        return IPAddress();
+
+    // Keep an expired address around in case the resolver is broken
+    Entry *_e = find(host, hashName(host));
+    bool _stale = _e && _e->state == POSITIVE &&
+        (uint32_t) (millis() - _e->expires) <= DNS_CACHE_STALE_MAX * 1000UL;
+    IPAddress _staleIP;
+    if (_stale)
+        _staleIP = IPAddress(_e->ip[0], _e->ip[1], _e->ip[2], _e->ip[3]);
+
+    cached = false;
+    uint32_t _start = millis();
+    uint32_t _ttl = DNS_CACHE_TTL;
+    DnsResolver::Status _status = DnsResolver::FAILED;
+    DnsResolver *_via = _fast ? _fastPath : _resolver;
+    if (_fast)
+        _fastPathLookups++;
+    if (_via)
+        _status = _via->resolve(host, _ip, _ttl);
+    if (_status == DnsResolver::BAD_NAME)
+        return IPAddress();     // not a lookup that failed, nothing to cache
+    if (_status == DnsResolver::FAILED) {
+        _ttl = DNS_CACHE_TTL;
+        _ip = WiFi.resolve(host);
+        if (!(uint32_t) _ip)
+            _status = millis() - _start >= DNS_RESOLVE_TIMEOUT ? DnsResolver::TIMEOUT : DnsResolver::NXDOMAIN;
+    }
+    if ((uint32_t) _ip) {
+        put(host, _ip, _ttl);
+        return _ip;
+    }
+    if (_stale) {
+        _staleHits++;
+        cached = true;
+        return _staleIP;
+    }
+    putNegative(host, _status == DnsResolver::TIMEOUT ? DNS_CACHE_TIMEOUT_TTL : DNS_CACHE_NXDOMAIN_TTL);
+    return IPAddress();
+}
+
+void DnsCache::forget(const char *host)
+{
+    Entry *_e = find(host, hashName(host));
+    if (_e) {
+        // an expired negative entry keeps the probe chain and is reused first
+        _e->state = NEGATIVE_ENTRY;
+        _e->expires = millis();
+    }
+}
+
+static int tracedConnect(TCPClient &client, IPAddress ip, uint16_t port)
+{
+    trace(TR_TCP_CONNECT, port);
+    int _ret = client.connect(ip, port);
+    trace(_ret ? TR_TCP_CONNECTED : TR_TCP_FAILED);
+    return _ret;
+}
+
+int DnsCache::connectFresh(TCPClient &client, const char *host, uint16_t port)
+{
+    IPAddress _ip = WiFi.resolve(host);
+    if (!(uint32_t) _ip)
+        return 0;
+    put(host, _ip);         // still good for the cached connects
+    return tracedConnect(client, _ip, port);
+}
+
+int DnsCache::connect(TCPClient &client, const char *host, uint16_t port)
+{
+    bool _cached;
+    IPAddress _ip = resolve(host, _cached);
+    if (!(uint32_t) _ip)
+        return 0;
+    if (tracedConnect(client, _ip, port))
+        return 1;
+    if (!_cached)
+        return 0;
+
+    // The cached address did not answer, it may have moved - look it up again
+    forget(host);
+    IPAddress _fresh = resolve(host, _cached);
+    if (!(uint32_t) _fresh || _fresh == _ip)
+        return 0;
+    return tracedConnect(client, _fresh, port);
+}
+
+void DnsCache::print(Print &out)
+{
+    uint32_t _now = millis();
+    uint8_t _used = 0;
+    char _buf[16];
+
+    for (uint8_t i = 0; i < DNS_CACHE_SLOTS; i++) {
+        const Entry &_e = _slot[i];
+        if (_e.state == EMPTY)
+            continue;
+        int32_t _left = (int32_t) (_e.expires - _now);
+        if (_e.state == NEGATIVE_ENTRY && _left <= 0)
+            continue;
+        _used++;
+        out.print("   ");
+        out.print(_e.name);
+        out.print("  ");
+        if (_e.state == NEGATIVE_ENTRY)
+            out.print("negative");
+        else {
+            formatIPv4(_buf, _e.ip);
+            out.print(_buf);
+        }
+        if (_left > 0) {
+            out.print("  ttl ");
+            out.print(_left / 1000);
+            out.println("s");
+        } else
+            out.println("  stale");
+    }
+    if (!_used)
+        out.println("   (empty)");
+    out.print("Hits ");
+    out.print(_hits);
+    out.print("  misses ");
+    out.print(_misses);
+    out.print("  negative ");
+    out.print(_negativeHits);
+    out.print("  stale ");
+    out.print(_staleHits);
+    out.print("  fast path ");
+    out.println(_fastPathLookups);
+}
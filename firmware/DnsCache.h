@@ -0,0 +1,105 @@
+/*
+ *  DnsCache.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Host name to IPv4 cache in front of TCPClient::connect(host).
+ *
+ *  Fixed number of slots, open addressing with linear probing, no
+ *  allocation.  Entries expire after their TTL.  Failed lookups are cached
+ *  too (negative entries) so a name that does not resolve does not cost a
+ *  resolver round trip - or a full resolver timeout - on every retry.
+ *
+ *  An expired positive entry is kept as a fallback: if the fresh lookup
+ *  fails, which is what happens while the CC3000 DNS is stuck at 76.83.0.0,
+ *  connect() still uses the last known address.  connectFresh() does not,
+ *  it is what tests the CC3000 DNS.
+ *
+ *  With a DnsResolver set, misses are resolved over UDP and cached with the
+ *  TTL from the answer; the CC3000 resolver is only used when the UDP lookup
+ *  could not be made at all.
+ *
+ *  With a fast path resolver set instead, misses go over UDP only while the
+ *  CC3000 DNS server is 76.83.0.0 - the resolver skips it and asks the
+ *  gateway and USER_DNS - so lookups keep working with the link up and the
+ *  reconnect of Fix DNS can wait.
+ */
+
+#ifndef DNSCACHE_H_
+#define DNSCACHE_H_
+
+#include <application.h>
+#include "DnsResolver.h"
+
+#define DNS_CACHE_SLOTS         16      // must be a power of two
+#define DNS_CACHE_NAME_MAX      39      // longer names are resolved but not cached
+#define DNS_CACHE_TTL           300     // s, when the resolver does not report a TTL
+#define DNS_CACHE_MAX_TTL       86400   // s
+#define DNS_CACHE_NXDOMAIN_TTL  60      // s, name does not exist
+#define DNS_CACHE_TIMEOUT_TTL   10      // s, resolver did not answer
+#define DNS_CACHE_STALE_MAX     86400   // s an expired address is kept as a fallback
+#define DNS_RESOLVE_TIMEOUT     2000    // ms, a CC3000 lookup failing slower than this timed out
+
+class DnsCache {
+public:
+    enum Result { MISS, HIT, NEGATIVE };
+
+    DnsCache() : _resolver(NULL), _fastPath(NULL) { clear(); }
+
+    void clear();
+    Result lookup(const char *host, IPAddress &ip);
+    void put(const char *host, IPAddress ip, uint32_t ttl = DNS_CACHE_TTL);
+    void putNegative(const char *host, uint32_t ttl);
+    void forget(const char *host);
+    void setResolver(DnsResolver *resolver) { _resolver = resolver; }
+    DnsResolver *resolver() const { return _resolver; }
+    void setFastPath(DnsResolver *resolver) { _fastPath = resolver; }
+    DnsResolver *fastPath() const { return _fastPath; }
+
+    // Resolve through the cache, the resolver on a miss
+    IPAddress resolve(const char *host);
+
+    // TCPClient::connect(host, port), by IP whenever the cache can supply one
+    int connect(TCPClient &client, const char *host, uint16_t port);
+    // Looked up by the CC3000 every time, never from the cache or over UDP -
+    // for the DNS test, which must fail while the DNS server is 76.83.0.0
+    int connectFresh(TCPClient &client, const char *host, uint16_t port);
+
+    void print(Print &out);
+
+    uint32_t hits() const { return _hits; }
+    uint32_t misses() const { return _misses; }
+    uint32_t negativeHits() const { return _negativeHits; }
+    uint32_t staleHits() const { return _staleHits; }
+    uint32_t fastPathLookups() const { return _fastPathLookups; }
+
+private:
+    enum State { EMPTY = 0, POSITIVE, NEGATIVE_ENTRY };
+
+    struct Entry {
+        uint32_t hash;
+        uint32_t expires;       // millis()
+        uint8_t ip[4];
+        uint8_t state;
+        char name[DNS_CACHE_NAME_MAX + 1];
+    };
+
+    static uint32_t hashName(const char *host);
+    static bool expired(const Entry &e, uint32_t now);
+    IPAddress resolve(const char *host, bool &cached);
+    Entry *find(const char *host, uint32_t hash);
+    Entry *slotFor(const char *host, uint32_t hash);
+    void store(const char *host, uint8_t state, const uint8_t *ip, uint32_t ttl);
+
+    Entry _slot[DNS_CACHE_SLOTS];
+    DnsResolver *_resolver;
+    DnsResolver *_fastPath;             // used only while the DNS server is bad
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _negativeHits;
+    uint32_t _staleHits;
+    uint32_t _fastPathLookups;
+};
+
+#endif /* DNSCACHE_H_ */
@@ -0,0 +1,312 @@
+/*
+ *  DnsResolver.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "DnsResolver.h"
+#include "IPv4.h"
+#include "NetState.h"
+
+#define DNS_TYPE_A      1
+#define DNS_CLASS_IN    1
+#define DNS_RCODE_NXDOMAIN 3
+
+static uint8_t _packet[DNS_PACKET_MAX];     // query being sent or answer being parsed
+
+static const char *_serverName[] = { "DHCP DNS", "Gateway", "User DNS" };
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t) get16(p) << 16) | get16(p + 2);
+}
+
+// Position after the (possibly compressed) name at pos, 0 if malformed
+static uint16_t skipName(uint16_t pos, uint16_t len)
+{
+    while (pos < len) {
+        uint8_t _l = _packet[pos];
+        if (!_l)
+            return pos + 1;
+        if ((_l & 0xC0) == 0xC0)
+            return pos + 2 <= len ? pos + 2 : 0;
+        if (_l > 63)
+            return 0;
+        pos += 1 + _l;
+    }
+    return 0;
+}
+
+DnsResolver::DnsResolver()
+    : _id(0), _status(IDLE), _nxdomain(false), _startUs(0), _startMs(0), _sentMs(0),
+      _elapsedUs(0), _ttl(0), _winner(-1), _timeouts(0)
+{
+    memset(_answered, 0, sizeof(_answered));
+    memset(_stats, 0, sizeof(_stats));
+    _host[0] = 0;
+}
+
+void DnsResolver::addServer(uint8_t server, IPAddress ip)
+{
+    if (!(uint32_t) ip)
+        return;
+    // the gateway is often the DNS server too, one query is enough
+    for (uint8_t i = 0; i < server; i++)
+        if (_ip[i] == ip)
+            return;
+    _ip[server] = ip;
+}
+
+bool DnsResolver::start(const char *host)
+{
+    cancel();
+    _status = FAILED;
+    _winner = -1;
+    _address = IPAddress();
+    _ttl = 0;
+    if (!*host || strlen(host) > DNS_NAME_MAX) {
+        _status = BAD_NAME;
+        return false;
+    }
+    strcpy(_host, host);
+    // example.com. is example.com, the answer's question has no trailing dot
+    uint8_t _len = strlen(_host);
+    if (_len > 1 && _host[_len - 1] == '.')
+        _host[_len - 1] = 0;
+    if (!encode()) {
+        _status = BAD_NAME;     // an empty or over long label, no server can answer it
+        return false;
+    }
+    if (!WiFi.ready())
+        return false;
+
+    for (uint8_t i = 0; i < SERVER_COUNT; i++) {
+        _ip[i] = IPAddress();
+        _answered[i] = false;
+    }
+    NetState _net;
+    netStateRead(_net);
+    if (_net.dnsSet && !_net.dnsBad)
+        addServer(DHCP_DNS, _net.dns.toIPAddress());
+    addServer(GATEWAY, WiFi.gatewayIP());
+    addServer(USER_DNS_SERVER, _userDNS);
+
+    if (!_udp.begin(DNS_LOCAL_PORT))
+        return false;
+    _id = (uint16_t) (micros() ^ (_id << 3)) | 1;
+    _nxdomain = false;
+    _status = BUSY;
+    _startUs = micros();
+    _startMs = _sentMs = millis();
+    for (uint8_t i = 0; i < SERVER_COUNT; i++)
+        send(i);
+    return true;
+}
+
+uint16_t DnsResolver::encode()
+{
+    static const uint8_t _header[] = { 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0 };   // RD, QDCOUNT 1
+
+    _packet[0] = _id >> 8;
+    _packet[1] = _id;
+    memcpy(_packet + 2, _header, sizeof(_header));
+
+    // www.example.com -> 3www7example3com0
+    uint16_t _pos = 12;
+    const char *_label = _host;
+    while (*_label) {
+        const char *_dot = strchr(_label, '.');
+        uint8_t _l = _dot ? _dot - _label : strlen(_label);
+        if (!_l || _l > 63)
+            return 0;
+        _packet[_pos++] = _l;
+        memcpy(_packet + _pos, _label, _l);
+        _pos += _l;
+        _label += _l + (_dot ? 1 : 0);
+    }
+    _packet[_pos++] = 0;
+    _packet[_pos++] = 0;
+    _packet[_pos++] = DNS_TYPE_A;
+    _packet[_pos++] = 0;
+    _packet[_pos++] = DNS_CLASS_IN;
+    return _pos;
+}
+
+void DnsResolver::send(uint8_t server)
+{
+    if (!(uint32_t) _ip[server] || _answered[server])
+        return;
+    uint16_t _len = encode();  // checked in start()
+    _udp.beginPacket(_ip[server], DNS_PORT);
+    _udp.write(_packet, _len);
+    _udp.endPacket();
+    _stats[server].sent++;
+}
+
+int8_t DnsResolver::serverFor(IPAddress ip) const
+{
+    for (uint8_t i = 0; i < SERVER_COUNT; i++)
+        if ((uint32_t) _ip[i] && _ip[i] == ip)
+            return i;
+    return -1;
+}
+
+/*
+ *  IDLE if the packet is not an answer to the current query
+ */
+DnsResolver::Status DnsResolver::parse(uint16_t len)
+{
+    if (len < 12 || get16(_packet) != _id || !(_packet[2] & 0x80) || get16(_packet + 4) != 1)
+        return IDLE;
+
+    // the question must be ours
+    uint16_t _pos = 12;
+    const char *_h = _host;
+    while (_pos < len && _packet[_pos]) {
+        uint8_t _l = _packet[_pos++];
+        if (_l > 63 || _pos + _l >= len || strncasecmp((const char *) _packet + _pos, _h, _l))
+            return IDLE;
+        _h += _l;
+        if (*_h != (_packet[_pos + _l] ? '.' : 0))
+            return IDLE;
+        if (*_h)
+            _h++;
+        _pos += _l;
+    }
+    if (*_h || _pos + 5 > len || get16(_packet + _pos + 1) != DNS_TYPE_A ||
+            get16(_packet + _pos + 3) != DNS_CLASS_IN)
+        return IDLE;
+    _pos += 5;
+
+    uint8_t _rcode = _packet[3] & 0x0F;
+    if (_rcode == DNS_RCODE_NXDOMAIN)
+        return NXDOMAIN;
+    if (_rcode)
+        return FAILED;
+
+    // first A record, the TTL is the shortest along a CNAME chain
+    uint16_t _answers = get16(_packet + 6);
+    uint32_t _ttlMin = 0xFFFFFFFF;
+    while (_answers--) {
+        _pos = skipName(_pos, len);
+        if (!_pos || _pos + 10 > len)
+            return FAILED;
+        uint16_t _type = get16(_packet + _pos);
+        uint16_t _class = get16(_packet + _pos + 2);
+        uint32_t _rrTtl = get32(_packet + _pos + 4);
+        uint16_t _rdLen = get16(_packet + _pos + 8);
+        _pos += 10;
+        if (_pos + _rdLen > len)
+            return FAILED;
+        if (_class == DNS_CLASS_IN && _rrTtl < _ttlMin)
+            _ttlMin = _rrTtl;
+        if (_type == DNS_TYPE_A && _class == DNS_CLASS_IN && _rdLen == 4) {
+            _address = IPAddress(_packet[_pos], _packet[_pos + 1], _packet[_pos + 2], _packet[_pos + 3]);
+            _ttl = _ttlMin;
+            return (uint32_t) _address ? FOUND : FAILED;
+        }
+        _pos += _rdLen;
+    }
+    return FAILED;
+}
+
+DnsResolver::Status DnsResolver::poll()
+{
+    if (_status != BUSY)
+        return _status;
+
+    int _len;
+    while ((_len = _udp.parsePacket()) > 0) {
+        int8_t _s = serverFor(_udp.remoteIP());
+        if (_s < 0 || _udp.remotePort() != DNS_PORT || _answered[_s]) {
+            _udp.flush();
+            continue;
+        }
+        _len = _udp.read(_packet, sizeof(_packet));
+        Status _r = _len > 0 ? parse(_len) : IDLE;
+        if (_r == IDLE)
+            continue;
+        _answered[_s] = true;
+        _stats[_s].answers++;
+        _stats[_s].totalUs += micros() - _startUs;
+        if (_r == FOUND) {
+            _winner = _s;
+            _stats[_s].wins++;
+            finish(FOUND);
+            return _status;
+        }
+        if (_r == NXDOMAIN)
+            _nxdomain = true;
+    }
+
+    bool _pending = false;
+    for (uint8_t i = 0; i < SERVER_COUNT; i++)
+        if ((uint32_t) _ip[i] && !_answered[i])
+            _pending = true;
+
+    uint32_t _now = millis();
+    if (!_pending)
+        finish(_nxdomain ? NXDOMAIN : FAILED);
+    else if (_now - _startMs >= DNS_QUERY_TIMEOUT) {
+        _timeouts++;
+        finish(_nxdomain ? NXDOMAIN : TIMEOUT);
+    }
+    else if (_now - _sentMs >= DNS_RESEND_INTERVAL) {
+        _sentMs = _now;
+        for (uint8_t i = 0; i < SERVER_COUNT; i++)
+            send(i);
+    }
+    return _status;
+}
+
+void DnsResolver::finish(Status status)
+{
+    _status = status;
+    _elapsedUs = micros() - _startUs;
+    _udp.stop();    // late answers are dropped with the socket
+}
+
+void DnsResolver::cancel()
+{
+    if (_status == BUSY)
+        finish(IDLE);
+}
+
+DnsResolver::Status DnsResolver::resolve(const char *host, IPAddress &ip, uint32_t &ttl)
+{
+    if (!start(host))
+        return _status;
+    while (poll() == BUSY)
+        delay(1);
+    ip = _address;
+    ttl = _ttl;
+    return _status;
+}
+
+void DnsResolver::print(Print &out)
+{
+    for (uint8_t i = 0; i < SERVER_COUNT; i++) {
+        out.print("   ");
+        out.print(_serverName[i]);
+        out.print("  sent ");
+        out.print(_stats[i].sent);
+        out.print("  answers ");
+        out.print(_stats[i].answers);
+        out.print("  wins ");
+        out.print(_stats[i].wins);
+        if (_stats[i].answers) {
+            out.print("  avg ");
+            out.print(_stats[i].totalUs / _stats[i].answers / 1000);
+            out.print(" ms");
+        }
+        out.println();
+    }
+    out.print("Timeouts ");
+    out.println(_timeouts);
+}
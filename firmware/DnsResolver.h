@@ -0,0 +1,92 @@
+/*
+ *  DnsResolver.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Application level DNS client over UDP, independent of the CC3000 resolver.
+ *
+ *  An A query for the name goes to the DHCP DNS server, the gateway and the
+ *  user DNS at the same time and the first valid answer wins.  A DHCP DNS of
+ *  76.83.0.0 (or 0.0.0.0) is skipped, so a core with a bad DNS setting still
+ *  resolves through the other two.  Servers that have not answered get the
+ *  query again every DNS_RESEND_INTERVAL until DNS_QUERY_TIMEOUT.
+ *
+ *  Queries are encoded and answers parsed in place in one static packet
+ *  buffer, no allocation.
+ */
+
+#ifndef DNSRESOLVER_H_
+#define DNSRESOLVER_H_
+
+#include <application.h>
+
+#define DNS_PORT                53
+#define DNS_LOCAL_PORT          10053
+#define DNS_PACKET_MAX          512     // UDP DNS message limit
+#define DNS_NAME_MAX            253
+#define DNS_QUERY_TIMEOUT       3000    // ms
+#define DNS_RESEND_INTERVAL     1000    // ms
+
+class DnsResolver {
+public:
+    enum Server { DHCP_DNS = 0, GATEWAY, USER_DNS_SERVER, SERVER_COUNT };
+    enum Status { IDLE, BUSY, FOUND, NXDOMAIN, TIMEOUT, FAILED, BAD_NAME };
+
+    DnsResolver();
+
+    void setUserDNS(IPAddress ip) { _userDNS = ip; }
+
+    // Non-blocking: start() sends the queries, poll() returns BUSY until
+    // an answer arrived or the lookup timed out.  A name that cannot go in
+    // a query fails start() at once with BAD_NAME.
+    bool start(const char *host);
+    Status poll();
+    void cancel();
+    bool busy() const { return _status == BUSY; }
+
+    // Blocking lookup, ttl in seconds
+    Status resolve(const char *host, IPAddress &ip, uint32_t &ttl);
+
+    IPAddress address() const { return _address; }
+    uint32_t ttl() const { return _ttl; }
+    int8_t winner() const { return _winner; }       // Server, -1 if none
+    uint32_t elapsedUs() const { return _elapsedUs; }
+
+    void print(Print &out);
+
+private:
+    struct ServerStats {
+        uint16_t sent;
+        uint16_t answers;
+        uint16_t wins;
+        uint32_t totalUs;
+    };
+
+    void addServer(uint8_t server, IPAddress ip);
+    void send(uint8_t server);
+    int8_t serverFor(IPAddress ip) const;
+    uint16_t encode();
+    Status parse(uint16_t len);
+    void finish(Status status);
+
+    UDP _udp;
+    IPAddress _userDNS;
+    IPAddress _ip[SERVER_COUNT];        // 0.0.0.0 = not used for this lookup
+    bool _answered[SERVER_COUNT];
+    char _host[DNS_NAME_MAX + 1];       // re-encoded for resends, matched against answers
+    uint16_t _id;
+    Status _status;
+    bool _nxdomain;                     // NXDOMAIN seen, final once every server answered
+    uint32_t _startUs;
+    uint32_t _startMs;
+    uint32_t _sentMs;
+    uint32_t _elapsedUs;
+    IPAddress _address;
+    uint32_t _ttl;
+    int8_t _winner;
+    ServerStats _stats[SERVER_COUNT];
+    uint16_t _timeouts;
+};
+
+#endif /* DNSRESOLVER_H_ */
@@ -0,0 +1,127 @@
+/*
+ *  DnsWatchdog.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "DnsWatchdog.h"
+#include "NetState.h"
+
+DnsWatchdog::DnsWatchdog(NetTask &task, Print &out)
+    : _task(task), _out(out), _enabled(false), _fixing(false), _fixDelay(FIX_DNS_BAD_WAIT), _lastCheck(0), _seen(0),
+      _bad(false), _badSince(0), _nextFix(0), _checks(0), _detected(0), _fixes(0),
+      _fixFailed(0), _recovered(0), _recoverySum(0), _recoveryMax(0), _lastRecovery(0)
+{
+}
+
+void DnsWatchdog::enable(bool on)
+{
+    _enabled = on;
+    _lastCheck = millis() - DNS_WATCHDOG_INTERVAL;  // look at once
+}
+
+void DnsWatchdog::setFixDelay(uint32_t ms)
+{
+    _fixDelay = ms;
+    if (_bad && ms != DNS_WATCHDOG_NO_FIX)
+        _nextFix = _badSince + ms;
+}
+
+void DnsWatchdog::check(uint32_t now)
+{
+    _checks++;
+    _lastCheck = now;
+    if (!WiFi.ready())
+        return;                         // nothing to judge without a link
+
+    if (!dnsIsBad()) {
+        if (_bad && dnsIsSet()) {
+            uint32_t _ms = now - _badSince;
+            _bad = false;
+            _recovered++;
+            _recoverySum += _ms;
+            if (_ms > _recoveryMax)
+                _recoveryMax = _ms;
+            _lastRecovery = _ms;
+            _out.print("watchdog: DNS good again after ");
+            printSeconds(_out, _ms);
+            _out.println(" s");
+        }
+        return;
+    }
+
+    if (!_bad) {
+        _bad = true;
+        _badSince = now;
+        _nextFix = now + _fixDelay;         // give the CC3000 a chance to replace it
+        _detected++;
+        _out.println("watchdog: DNS server is 76.83.0.0");
+    }
+}
+
+bool DnsWatchdog::run()
+{
+    if (!_enabled || _fixing)
+        return false;
+
+    uint32_t _now = millis();
+    if (netStateChanged(_seen))
+        check(_now);                    // a new link, lease or DNS server - look now
+    else if (_now - _lastCheck >= DNS_WATCHDOG_INTERVAL)
+        check(_now);
+
+    if (!_bad || _fixDelay == DNS_WATCHDOG_NO_FIX || (int32_t) (_now - _nextFix) < 0 ||
+        !WiFi.ready() || _task.busy())
+        return false;
+
+    _out.println("watchdog: fixing DNS");
+    _fixes++;
+    _fixing = _task.start(NetTask::FIX_DNS);
+    return _fixing;
+}
+
+void DnsWatchdog::fixDone(bool ok)
+{
+    _fixing = false;
+    if (ok)
+        check(millis());
+    else {
+        _fixFailed++;
+        _nextFix = millis() + DNS_WATCHDOG_RETRY;
+        _out.print("watchdog: fix failed, next try in ");
+        _out.print(DNS_WATCHDOG_RETRY / 1000);
+        _out.println(" s");
+    }
+}
+
+void DnsWatchdog::printStats(Print &out)
+{
+    out.print("DNS watchdog ");
+    out.print(_enabled ? "on" : "off");
+    out.print("  checks ");
+    out.print(_checks);
+    out.print("  bad DNS seen ");
+    out.print(_detected);
+    out.print("  fixes ");
+    out.print(_fixes);
+    out.print("  failed ");
+    out.println(_fixFailed);
+    out.print("   recovered ");
+    out.print(_recovered);
+    if (_recovered) {
+        out.print("  last ");
+        printSeconds(out, _lastRecovery);
+        out.print(" s  mean ");
+        printSeconds(out, _recoverySum / _recovered);
+        out.print(" s  max ");
+        printSeconds(out, _recoveryMax);
+        out.print(" s");
+    }
+    if (_bad) {
+        out.print("  bad for ");
+        printSeconds(out, millis() - _badSince);
+        out.print(" s");
+    }
+    out.println();
+}
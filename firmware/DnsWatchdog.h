@@ -0,0 +1,70 @@
+/*
+ *  DnsWatchdog.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Background DNS health check and automatic fix.
+ *
+ *  run() is called once per pass through loop() while nothing else is
+ *  running.  It looks at the DNS server whenever the NetState snapshot
+ *  changes and every DNS_WATCHDOG_INTERVAL ms otherwise.  A 76.83.0.0 DNS
+ *  server that is still there after the fix delay - FIX_DNS_BAD_WAIT, the
+ *  CC3000 sometimes replaces it on its own - starts a FIX_DNS on the
+ *  NetTask, which is bounded by its policy deadline; a fix that fails is
+ *  tried again after DNS_WATCHDOG_RETRY.  With lookups on the DnsCache fast
+ *  path a longer delay, or none at all, keeps the link up instead.
+ *  Recovery time runs from the first sight of the bad server to the first
+ *  sight of a good one.
+ */
+
+#ifndef DNSWATCHDOG_H_
+#define DNSWATCHDOG_H_
+
+#include <application.h>
+#include "NetTask.h"
+
+#define DNS_WATCHDOG_INTERVAL   5000    // ms between checks with nothing changing
+#define DNS_WATCHDOG_RETRY      60000   // ms after a failed fix before the next one
+#define DNS_WATCHDOG_LAZY       600000  // ms fix delay while the fast path serves lookups
+#define DNS_WATCHDOG_NO_FIX     0xFFFFFFFF  // fix delay, detect and count only
+
+class DnsWatchdog {
+public:
+    DnsWatchdog(NetTask &task, Print &out = Serial);
+
+    void enable(bool on);
+    bool enabled() const { return _enabled; }
+    void setFixDelay(uint32_t ms);      // bad DNS seen to FIX_DNS
+
+    bool run();                         // true when it has started a fix
+    bool fixing() const { return _fixing; }
+    void fixDone(bool ok);              // the NetTask fix it started has completed
+
+    void printStats(Print &out);
+
+private:
+    void check(uint32_t now);
+
+    NetTask &_task;
+    Print &_out;
+    bool _enabled;
+    bool _fixing;
+    uint32_t _fixDelay;
+    uint32_t _lastCheck;
+    uint32_t _seen;                     // NetState generation last looked at
+    bool _bad;                          // bad DNS seen and not yet recovered
+    uint32_t _badSince;
+    uint32_t _nextFix;                  // not before this millis()
+
+    uint16_t _checks;
+    uint16_t _detected;
+    uint16_t _fixes;
+    uint16_t _fixFailed;
+    uint16_t _recovered;
+    uint32_t _recoverySum;              // ms
+    uint32_t _recoveryMax;
+    uint32_t _lastRecovery;
+};
+
+#endif /* DNSWATCHDOG_H_ */
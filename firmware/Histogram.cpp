@@ -0,0 +1,104 @@
+/*
+ *  Histogram.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "Histogram.h"
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+void Histogram::clear()
+{
+    memset(_bucket, 0, sizeof(_bucket));
+    _count = 0;
+    _min = 0xFFFFFFFF;
+    _max = 0;
+    _sum = 0;
+}
+
+uint16_t Histogram::bucket(uint32_t us)
+{
+    if (us < 2 * SUB_BUCKETS)
+        return us;
+    uint8_t _exp = 31 - __builtin_clz(us);
+    uint8_t _sub = (us >> (_exp - HISTOGRAM_SUB_BITS)) & (SUB_BUCKETS - 1);
+    return 2 * SUB_BUCKETS + (_exp - HISTOGRAM_SUB_BITS - 1) * SUB_BUCKETS + _sub;
+}
+
+uint32_t Histogram::upper(uint16_t bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS)
+        return bucket;
+    uint8_t _shift = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    uint32_t _sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS;
+    return ((SUB_BUCKETS + _sub) << _shift) + ((1UL << _shift) - 1);
+}
+
+void Histogram::add(uint32_t us)
+{
+    uint16_t _b = bucket(us);
+    if (_bucket[_b] == 0xFFFF) {
+        // keep the shape, lose the oldest half of the resolution
+        for (uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            _bucket[i] = (_bucket[i] + 1) / 2;
+    }
+    _bucket[_b]++;
+    _count++;
+    _sum += us;
+    if (us < _min)
+        _min = us;
+    if (us > _max)
+        _max = us;
+}
+
+uint32_t Histogram::percentile(uint8_t pct) const
+{
+    uint32_t _total = 0;
+    for (uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        _total += _bucket[i];
+    if (!_total)
+        return 0;
+
+    uint32_t _rank = ((uint64_t) _total * pct + 99) / 100;
+    if (_rank < 1)
+        _rank = 1;
+    uint32_t _seen = 0;
+    for (uint16_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        _seen += _bucket[i];
+        if (_seen >= _rank) {
+            uint32_t _v = upper(i);
+            if (_v > _max)
+                _v = _max;
+            if (_v < _min)
+                _v = _min;
+            return _v;
+        }
+    }
+    return _max;
+}
+
+void printMs(Print &out, uint32_t us)
+{
+    out.print(us / 1000);
+    out.print('.');
+    out.print((us % 1000) / 100);
+}
+
+void Histogram::printMs(Print &out) const
+{
+    static const uint8_t _pct[] = { 50, 95, 99 };
+
+    out.print("min ");
+    ::printMs(out, min());
+    for (uint8_t i = 0; i < sizeof(_pct); i++) {
+        out.print("  p");
+        out.print(_pct[i]);
+        out.print(' ');
+        ::printMs(out, percentile(_pct[i]));
+    }
+    out.print("  max ");
+    ::printMs(out, max());
+    out.println(" ms");
+}
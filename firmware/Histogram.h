@@ -0,0 +1,50 @@
+/*
+ *  Histogram.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Fixed-bucket latency histogram, no allocation.
+ *
+ *  Samples are microseconds.  Values below 16 get a bucket each, above that
+ *  every power of two is split into 8 buckets, so a percentile is never off
+ *  by more than 12.5%.  min and max are kept exactly.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <application.h>
+
+#define HISTOGRAM_SUB_BITS  3
+#define HISTOGRAM_BUCKETS   ((32 - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS) + (2 << HISTOGRAM_SUB_BITS))
+
+class Histogram {
+public:
+    Histogram() { clear(); }
+
+    void clear();
+    void add(uint32_t us);
+    uint32_t count() const { return _count; }
+    uint32_t min() const { return _count ? _min : 0; }
+    uint32_t max() const { return _max; }
+    uint32_t mean() const { return _count ? (uint32_t) (_sum / _count) : 0; }
+    uint32_t percentile(uint8_t pct) const;
+
+    // "min 1.2 p50 3.4 p95 5.6 p99 7.8 max 9.0" in milliseconds
+    void printMs(Print &out) const;
+
+private:
+    static uint16_t bucket(uint32_t us);
+    static uint32_t upper(uint16_t bucket);
+
+    uint16_t _bucket[HISTOGRAM_BUCKETS];
+    uint32_t _count;
+    uint32_t _min;
+    uint32_t _max;
+    uint64_t _sum;
+};
+
+void printMs(Print &out, uint32_t us);     // microseconds as "12.3"
+
+#endif /* HISTOGRAM_H_ */
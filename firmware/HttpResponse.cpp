@@ -0,0 +1,143 @@
+/*
+ *  HttpResponse.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "HttpResponse.h"
+
+// token in a comma separated header value, case-insensitive as HTTP tokens are
+static bool hasToken(const char *value, const char *token)
+{
+    uint8_t _len = strlen(token);
+    while (*value) {
+        while (*value == ' ' || *value == '\t' || *value == ',')
+            value++;
+        const char *_start = value;
+        while (*value && *value != ',' && *value != ' ' && *value != '\t')
+            value++;
+        if (value - _start == _len && !strncasecmp(_start, token, _len))
+            return true;
+    }
+    return false;
+}
+
+void HttpResponse::begin()
+{
+    _headerBytes = 0;
+    _body = 0;
+    _length = -1;
+    _status = 0;
+    _inHeader = true;
+    _keepAlive = false;
+    _closed = false;
+    _chunked = false;
+    _chunk = C_SIZE;
+    _chunkLeft = 0;
+    _firstLine = true;
+    _lineLen = 0;
+}
+
+void HttpResponse::header(uint8_t c)
+{
+    _headerBytes++;
+    if (c == '\r')
+        return;
+    if (c != '\n') {
+        if (_lineLen < sizeof(_line) - 1)
+            _line[_lineLen++] = c;
+        return;
+    }
+    _line[_lineLen] = 0;
+    if (_firstLine) {
+        // HTTP/1.1 200 OK - 1.1 keeps the connection unless told otherwise
+        const char *_sp = strchr(_line, ' ');
+        if (_sp)
+            _status = atoi(_sp + 1);
+        _keepAlive = !strncmp(_line, "HTTP/1.1", 8);
+        _firstLine = false;
+    } else if (!_lineLen) {
+        if (_status >= 100 && _status < 200 && _status != 101) {
+            // 100 Continue and the like - the real response follows
+            _status = 0;
+            _length = -1;
+            _keepAlive = false;
+            _chunked = false;
+            _firstLine = true;
+            return;
+        }
+        _inHeader = false;
+        if (_status == 204 || _status == 304 || _status == 101) {
+            _length = 0;                        // never a body
+            _chunked = false;
+        }
+    } else if (!strncasecmp(_line, "Content-Length:", 15))
+        _length = atol(_line + 15);
+    else if (!strncasecmp(_line, "Connection:", 11))
+        _keepAlive = !hasToken(_line + 11, "close");
+    else if (!strncasecmp(_line, "Transfer-Encoding:", 18))
+        _chunked = hasToken(_line + 18, "chunked");
+    _lineLen = 0;
+}
+
+/*
+ *  Chunk framing, a byte at a time - the data itself is counted in feed()
+ */
+void HttpResponse::chunk(uint8_t c)
+{
+    switch (_chunk) {
+        case C_SIZE:
+        case C_EXTENSION:
+            if (c == '\n')
+                _chunk = _chunkLeft ? C_DATA : C_TRAILER;
+            else if (_chunk == C_SIZE && c >= '0' && c <= '9')
+                _chunkLeft = _chunkLeft << 4 | (c - '0');
+            else if (_chunk == C_SIZE && (c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+                _chunkLeft = _chunkLeft << 4 | ((c | 0x20) - 'a' + 10);
+            else if (c != '\r')
+                _chunk = C_EXTENSION;
+            break;
+        case C_DATA_END:
+            if (c == '\n')
+                _chunk = C_SIZE;
+            break;
+        case C_TRAILER:
+            if (c == '\n') {
+                if (!_lineLen)
+                    _chunk = C_DONE;
+                _lineLen = 0;
+            } else if (c != '\r' && _lineLen < 255)
+                _lineLen++;
+            break;
+        default:
+            break;
+    }
+}
+
+uint16_t HttpResponse::feed(const uint8_t *data, uint16_t len)
+{
+    uint16_t i = 0;
+    while (_inHeader && i < len)
+        header(data[i++]);
+    if (_chunked && !_inHeader) {
+        while (i < len && _chunk != C_DONE) {
+            if (_chunk != C_DATA) {
+                chunk(data[i++]);
+                continue;
+            }
+            uint32_t _take = (uint32_t) (len - i) < _chunkLeft ? len - i : _chunkLeft;
+            _body += _take;
+            _chunkLeft -= _take;
+            i += _take;
+            if (!_chunkLeft)
+                _chunk = C_DATA_END;
+        }
+        return i;
+    }
+    uint32_t _take = len - i;
+    if (_length >= 0 && _take > (uint32_t) _length - _body)
+        _take = _length - _body;
+    _body += _take;
+    return i + _take;
+}
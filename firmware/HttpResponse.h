@@ -0,0 +1,71 @@
+/*
+ *  HttpResponse.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Incremental HTTP/1.1 response parser.
+ *
+ *  feed() takes the response as it is read, in chunks of any size.  The
+ *  status, Content-Length, Transfer-Encoding and Connection headers are
+ *  picked out of the header a line at a time; the body is only counted, up
+ *  to its length or to the last chunk of a chunked body, so a keep-alive
+ *  connection can carry the next response right after it.  A response
+ *  framed by neither ends when the server closes, so it never keeps the
+ *  connection.  Interim 1xx responses (100 Continue) are skipped, and the
+ *  Connection and Transfer-Encoding tokens match in any case.
+ */
+
+#ifndef HTTPRESPONSE_H_
+#define HTTPRESPONSE_H_
+
+#include <application.h>
+
+class HttpResponse {
+public:
+    HttpResponse() { begin(); }
+
+    void begin();
+    uint16_t feed(const uint8_t *data, uint16_t len);  // bytes taken, less once complete
+    void close() { _closed = true; }                    // the server closed the connection
+
+    bool inHeader() const { return _inHeader; }
+    // the whole body is in - by the last chunk, its length, or by the close when it has neither
+    bool complete() const
+        { return !_inHeader && (_chunked ? _chunk == C_DONE : _length >= 0 ? _body >= (uint32_t) _length : _closed); }
+    uint16_t status() const { return _status; }         // 0 if no status line yet
+    int32_t length() const { return _chunked ? -1 : _length; }  // Content-Length, -1 if none
+    bool chunked() const { return _chunked; }
+    bool keepAlive() const { return _keepAlive && (_chunked || _length >= 0); }
+    uint32_t headerBytes() const { return _headerBytes; }
+    uint32_t bodyBytes() const { return _body; }
+
+private:
+    enum Chunk {
+        C_SIZE,         // hex size
+        C_EXTENSION,    // ;name=value after the size, ignored
+        C_DATA,
+        C_DATA_END,     // CRLF after the data
+        C_TRAILER,      // header lines after the last chunk, up to an empty one
+        C_DONE
+    };
+
+    void header(uint8_t c);
+    void chunk(uint8_t c);
+
+    uint32_t _headerBytes;
+    uint32_t _body;
+    int32_t _length;
+    uint16_t _status;
+    bool _inHeader;
+    bool _keepAlive;
+    bool _closed;
+    bool _chunked;
+    uint8_t _chunk;
+    uint32_t _chunkLeft;
+    bool _firstLine;
+    char _line[32];                     // the start of the header line
+    uint8_t _lineLen;
+};
+
+#endif /* HTTPRESPONSE_H_ */
@@ -0,0 +1,89 @@
+/*
+ *  IPv4.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  IPv4 address value type with one byte order path.
+ *
+ *  An IPv4 holds the address as a.b.c.d packed first octet high, the way it
+ *  is written.  The CC3000 wants and gives the same address in two other
+ *  layouts and each has one conversion here:
+ *
+ *      netapp_dhcp()   words whose bytes in memory are a, b, c, d -
+ *                      netapp(), byte swapped on the little endian Core
+ *      ip_config       byte arrays holding d, c, b, a - fromConfig()
+ *      IPAddress       a, b, c, d - fromIPAddress() / toIPAddress()
+ *
+ *  Everything but the IPAddress conversions is constexpr, so addresses and
+ *  whole configurations built from constants are packed, checked and laid
+ *  out by the compiler.
+ */
+
+#ifndef IPV4_H_
+#define IPV4_H_
+
+#include <application.h>
+
+class IPv4 {
+public:
+    constexpr IPv4() : _value(0) {}
+    constexpr IPv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _value((uint32_t) a << 24 | (uint32_t) b << 16 | (uint32_t) c << 8 | d) {}
+
+    static constexpr IPv4 fromValue(uint32_t value) { return IPv4(value, 0); }
+    // ip_config.aucIP, aucDNSServer, ... - the octets reversed
+    static constexpr IPv4 fromConfig(const unsigned char *reversed)
+        { return IPv4(reversed[3], reversed[2], reversed[1], reversed[0]); }
+    static IPv4 fromIPAddress(const IPAddress &ip) { return IPv4(ip[0], ip[1], ip[2], ip[3]); }
+
+    static constexpr uint32_t swap(uint32_t v)
+        { return v >> 24 | (v >> 8 & 0x0000FF00) | (v << 8 & 0x00FF0000) | v << 24; }
+
+    constexpr uint32_t value() const { return _value; }                 // a.b.c.d, a high
+    constexpr uint32_t netapp() const { return swap(_value); }          // for netapp_dhcp()
+    constexpr uint8_t operator[](uint8_t octet) const { return _value >> (24 - 8 * octet); }
+    IPAddress toIPAddress() const { return IPAddress((*this)[0], (*this)[1], (*this)[2], (*this)[3]); }
+
+    constexpr bool isZero() const { return _value == 0; }
+    constexpr bool operator==(const IPv4 &ip) const { return _value == ip._value; }
+    constexpr bool operator!=(const IPv4 &ip) const { return _value != ip._value; }
+    constexpr bool sameNetwork(const IPv4 &ip, const IPv4 &mask) const
+        { return !((_value ^ ip._value) & mask._value); }
+    // 255.255.255.0 is, 255.0.255.0 and 0.0.0.0 are not
+    constexpr bool isMask() const { return _value && !((~_value + 1) & ~_value); }
+
+private:
+    constexpr IPv4(uint32_t value, int) : _value(value) {}
+
+    uint32_t _value;
+};
+
+#define IPV4_BAD_DNS    IPv4(76, 83, 0, 0)      // the TI chip bad DNS
+
+/*
+ *  A static configuration, or DHCP when the IP address is 0.0.0.0
+ */
+struct IPv4Config {
+    IPv4 ip;
+    IPv4 subnetMask;
+    IPv4 defaultGateway;
+    IPv4 dnsServer;
+
+    constexpr bool dhcp() const { return ip.isZero(); }
+    constexpr bool operator==(const IPv4Config &c) const
+        { return ip == c.ip && subnetMask == c.subnetMask &&
+                 defaultGateway == c.defaultGateway && dnsServer == c.dnsServer; }
+
+    // a host address on a real subnet with the gateway on it and a DNS server
+    constexpr bool valid() const
+        { return dhcp() || (subnetMask.isMask() && ip.sameNetwork(defaultGateway, subnetMask) &&
+                            ip != defaultGateway &&
+                            (ip.value() & ~subnetMask.value()) != 0 &&
+                            (ip.value() | subnetMask.value()) != 0xFFFFFFFF &&
+                            !dnsServer.isZero()); }
+};
+
+#define IPV4_DHCP   IPv4Config()
+
+#endif /* IPV4_H_ */
@@ -0,0 +1,194 @@
+/*
+ *  KeepAlive.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "KeepAlive.h"
+#include "SerialOut.h"
+#include "Trace.h"
+
+void KeepAlive::Latency::add(uint32_t ms)
+{
+    if (!count || ms < min)
+        min = ms;
+    if (ms > max)
+        max = ms;
+    sum += ms;
+    count++;
+}
+
+void KeepAlive::Latency::print(Print &out, const char *label) const
+{
+    out.print(label);
+    printRight(out, count, 6);
+    printRight(out, min, 7);
+    printRight(out, avg(), 7);
+    printRight(out, max, 7);
+    out.println();
+}
+
+KeepAlive::KeepAlive(const char *host, const char *path, uint16_t port, Print &out)
+    : _out(out), _host(host), _path(path), _port(port), _cache(NULL), _open(false), _step(S_IDLE),
+      _requests(0), _done(0), _failures(0), _reopened(0), _reused(false), _retried(false),
+      _requestAt(0), _sentAt(0), _connectMs(0)
+{
+    _newConn.clear();
+    _reusedConn.clear();
+    _connect.clear();
+}
+
+bool KeepAlive::start(uint16_t requests, DnsCache *cache)
+{
+    if (busy() || !requests)
+        return false;
+    _cache = cache;
+    _requests = requests;
+    _done = 0;
+    _failures = 0;
+    _reopened = 0;
+    _newConn.clear();
+    _reusedConn.clear();
+    _connect.clear();
+    _out.print("Keep-alive ");
+    _out.print(requests);
+    _out.print(" requests to ");
+    _out.print(_host);
+    _out.println(_path);
+    _retried = false;
+    _step = S_SEND;
+    return true;
+}
+
+void KeepAlive::stop()
+{
+    if (busy()) {
+        _requests = _done;
+        _step = S_IDLE;
+    }
+}
+
+void KeepAlive::close()
+{
+    _client.stop();
+    _open = false;
+}
+
+/*
+ *  One request, on the open socket if it is still up, else on a new one
+ */
+void KeepAlive::send()
+{
+    uint32_t _t = millis();
+    if (!_retried)
+        _requestAt = _t;                // a retry counts from the first send
+    _connectMs = 0;
+    _reused = _open && _client.connected();
+    if (_open && !_reused) {
+        // closed while idle - the server's keep-alive timeout or the CC3000
+        _reopened++;
+        close();
+    }
+    if (!_reused) {
+        int _ok = _cache ? _cache->connect(_client, _host, _port) : _client.connect(_host, _port);
+        _connectMs = millis() - _t;
+        if (!_ok) {
+            _client.stop();
+            finish(false);
+            return;
+        }
+        _open = true;
+    }
+    _client.print("GET ");
+    _client.print(_path);
+    _client.print(" HTTP/1.1\r\nHost: ");
+    _client.print(_host);
+    _client.print("\r\nConnection: keep-alive\r\n\r\n");
+    _sentAt = millis();
+    _response.begin();
+    _step = S_WAITING;
+}
+
+void KeepAlive::finish(bool ok)
+{
+    uint32_t _ms = millis() - _requestAt;
+    if (ok) {
+        if (_reused)
+            _reusedConn.add(_ms);
+        else {
+            _newConn.add(_ms);
+            _connect.add(_connectMs);
+        }
+        _out.print(_reused ? '.' : 'o');
+    } else {
+        _failures++;
+        close();
+        _out.print('x');
+    }
+    if (ok && !_response.keepAlive())
+        close();                        // the server will not keep it
+    _retried = false;
+    if (++_done % 50 == 0)
+        _out.println();
+    _step = S_SEND;
+}
+
+bool KeepAlive::run()
+{
+    if (!busy())
+        return false;
+
+    if (_step == S_SEND) {
+        if (_done < _requests) {
+            send();
+            return false;
+        }
+        _step = S_IDLE;
+        _out.println();
+        report(_out);
+        return true;
+    }
+
+    // S_WAITING
+    uint8_t _buf[KEEPALIVE_CHUNK];
+    int _n;
+    while (!_response.complete() && _client.available() && (_n = _client.read(_buf, sizeof(_buf))) > 0) {
+        if (!_response.headerBytes())
+            trace(TR_FIRST_BYTE, _n);
+        _response.feed(_buf, _n);
+    }
+
+    if (_response.complete())
+        finish(true);
+    else if (!_client.connected()) {
+        _response.close();
+        if (_response.complete())
+            finish(true);
+        else if (_reused && !_response.headerBytes() && !_retried) {
+            // the socket was dead though it looked open - once more on a new one
+            _reopened++;
+            _retried = true;
+            close();
+            send();
+        } else
+            finish(false);
+    } else if (millis() - _sentAt >= KEEPALIVE_TIMEOUT)
+        finish(false);
+    return false;
+}
+
+void KeepAlive::report(Print &out)
+{
+    out.println("   connection  count    min    avg    max ms");
+    _newConn.print(out, "   new       ");
+    _reusedConn.print(out, "   reused    ");
+    _connect.print(out, "   (connect) ");
+    out.print("Keep-alive ");
+    out.print(_done - _failures);
+    out.print('/');
+    out.print(_requests);
+    out.print(" ok, ");
+    out.print(_reopened);
+    out.println(" dead sockets reopened");
+}
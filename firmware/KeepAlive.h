@@ -0,0 +1,87 @@
+/*
+ *  KeepAlive.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Repeated HTTP/1.1 requests over one keep-alive connection.
+ *
+ *  The socket to the test host stays open between requests and between
+ *  runs, so a request costs only its round trip instead of a lookup, a
+ *  handshake and a teardown.  A socket the server or the CC3000 has closed
+ *  is found before the request goes out, or by the connection dropping with
+ *  no answer, and is reopened and the request sent again without counting
+ *  as a failure.  New and reused connection latency are reported side by
+ *  side.
+ */
+
+#ifndef KEEPALIVE_H_
+#define KEEPALIVE_H_
+
+#include <application.h>
+#include "DnsCache.h"
+#include "HttpResponse.h"
+
+#define KEEPALIVE_REQUESTS  10      // requests per run
+#define KEEPALIVE_CHUNK     256     // bytes per read()
+#define KEEPALIVE_TIMEOUT   10000   // ms for a response
+
+class KeepAlive {
+public:
+    KeepAlive(const char *host, const char *path, uint16_t port = 80, Print &out = Serial);
+
+    bool start(uint16_t requests = KEEPALIVE_REQUESTS, DnsCache *cache = NULL);
+    bool run();                         // true once, when the run completes
+    void stop();                        // the run, the connection stays open
+    void close();                       // the connection
+    bool busy() const { return _step != S_IDLE; }
+
+    uint16_t requests() const { return _requests; }
+    uint16_t failures() const { return _failures; }
+    uint16_t reopened() const { return _reopened; }
+    uint32_t newAvgMs() const { return _newConn.avg(); }
+    uint32_t reusedAvgMs() const { return _reusedConn.avg(); }
+    void report(Print &out);
+
+private:
+    enum Step { S_IDLE, S_SEND, S_WAITING };
+
+    struct Latency {
+        uint16_t count;
+        uint32_t sum;                   // ms
+        uint32_t min;
+        uint32_t max;
+
+        void clear() { count = 0; sum = 0; min = 0; max = 0; }
+        void add(uint32_t ms);
+        uint32_t avg() const { return count ? sum / count : 0; }
+        void print(Print &out, const char *label) const;
+    };
+
+    void send();
+    void finish(bool ok);
+
+    Print &_out;
+    TCPClient _client;
+    const char *_host;
+    const char *_path;
+    uint16_t _port;
+    DnsCache *_cache;
+    bool _open;                         // we think the socket is up
+    Step _step;
+    uint16_t _requests;
+    uint16_t _done;
+    uint16_t _failures;
+    uint16_t _reopened;                 // dead sockets found and reopened
+    bool _reused;                       // this request went out on an open socket
+    bool _retried;                      // and was sent again on a new one
+    uint32_t _requestAt;                // before the connect, if there was one
+    uint32_t _sentAt;
+    uint32_t _connectMs;
+    HttpResponse _response;
+    Latency _newConn;                   // connect + request
+    Latency _reusedConn;                // request only
+    Latency _connect;
+};
+
+#endif /* KEEPALIVE_H_ */
@@ -0,0 +1,122 @@
+/*
+ *  NetConfig.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "NetConfig.h"
+#include "Trace.h"
+
+/*
+ *  Network profile in EEPROM
+ */
+#define NET_PROFILE_SIZE 19
+
+static uint8_t profileChecksum(const uint8_t *data)
+{
+    uint8_t _sum = 0;
+    for (uint8_t i = 0; i < NET_PROFILE_SIZE - 1; i++)
+        _sum = (_sum << 1 | _sum >> 7) ^ data[i];
+    return _sum;
+}
+
+static void putU32(uint8_t *data, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++)
+        data[i] = value >> (24 - 8 * i);
+}
+
+static uint32_t getU32(const uint8_t *data)
+{
+    return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+}
+
+bool loadNetProfile(NetProfile &profile)
+{
+    uint8_t _data[NET_PROFILE_SIZE];
+    for (uint8_t i = 0; i < NET_PROFILE_SIZE; i++)
+        _data[i] = EEPROM.read(NET_PROFILE_EEPROM_ADDR + i);
+    if (_data[0] != NET_PROFILE_MAGIC || _data[NET_PROFILE_SIZE - 1] != profileChecksum(_data))
+        return false;
+    profile.dhcp = _data[1] != 0;
+    profile.config.ip = IPv4::fromValue(getU32(_data + 2));
+    profile.config.subnetMask = IPv4::fromValue(getU32(_data + 6));
+    profile.config.defaultGateway = IPv4::fromValue(getU32(_data + 10));
+    profile.config.dnsServer = IPv4::fromValue(getU32(_data + 14));
+    return true;
+}
+
+// Only bytes that differ are written, the EEPROM is emulated in flash
+static void saveNetProfile(const IPv4Config &config)
+{
+    uint8_t _data[NET_PROFILE_SIZE];
+    _data[0] = NET_PROFILE_MAGIC;
+    _data[1] = config.dhcp();
+    putU32(_data + 2, config.ip.value());
+    putU32(_data + 6, config.subnetMask.value());
+    putU32(_data + 10, config.defaultGateway.value());
+    putU32(_data + 14, config.dnsServer.value());
+    _data[NET_PROFILE_SIZE - 1] = profileChecksum(_data);
+    for (uint8_t i = 0; i < NET_PROFILE_SIZE; i++)
+        if (EEPROM.read(NET_PROFILE_EEPROM_ADDR + i) != _data[i])
+            EEPROM.write(NET_PROFILE_EEPROM_ADDR + i, _data[i]);
+}
+
+bool netProfileMatches(const IPv4Config &config)
+{
+    NetProfile _p;
+    if (!loadNetProfile(_p))
+        return false;
+    // with DHCP the CC3000 ignores the other addresses
+    if (config.dhcp())
+        return _p.dhcp;
+    return !_p.dhcp && _p.config == config;
+}
+
+void forgetNetProfile()
+{
+    if (EEPROM.read(NET_PROFILE_EEPROM_ADDR) != 0xFF)
+        EEPROM.write(NET_PROFILE_EEPROM_ADDR, 0xFF);
+}
+
+bool setStaticIPAddress(const IPv4Config &config, bool force)
+{
+    // The CC3000 already holds these settings - no NVMEM write, no restart
+    if (!force && netProfileMatches(config))
+        return true;
+
+    // Update DHCP state with specified values.
+    uint32_t _ip = config.ip.netapp();
+    uint32_t _subnetMask = config.subnetMask.netapp();
+    uint32_t _defaultGateway = config.defaultGateway.netapp();
+    uint32_t _dnsServer = config.dnsServer.netapp();
+    if (netapp_dhcp(&_ip, &_subnetMask, &_defaultGateway, &_dnsServer) != 0) {
+      return false;
+    }
+
+    // Reset CC3000 to use modified setting.
+    wlan_stop();
+    delay(200);
+    wlan_start(0);
+    trace(TR_DHCP_RESET, config.dhcp());
+    saveNetProfile(config);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief    Set the CC3000 to use request an IP and network configuration
+              using DHCP.  Note that this DHCP state will be saved in the
+              CC3000's non-volatile storage and reused on next reconnect.
+              This means you only need to call this once and the CC3000 will
+              remember the setting forever.  To switch to use a static IP,
+              call the cc3000.setStaticIPAddress function.
+
+    @returns  False if an error occurred, true if successfully set.
+*/
+/**************************************************************************/
+bool setDHCP()
+{
+    return setStaticIPAddress(IPV4_DHCP);
+}
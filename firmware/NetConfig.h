@@ -0,0 +1,37 @@
+/*
+ *  NetConfig.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  CC3000 IP configuration helpers - DHCP or static IP/DNS, stored by the
+ *  CC3000 in its non-volatile memory.
+ *
+ *  The last configuration written is kept as a profile in EEPROM.  When the
+ *  requested settings match it, setStaticIPAddress() skips the NVMEM write
+ *  and the radio restart; force makes it write anyway, which is how Fix DNS
+ *  gets the CC3000 to drop a bad DNS setting.
+ */
+
+#ifndef NETCONFIG_H_
+#define NETCONFIG_H_
+
+#include <application.h>
+#include "IPv4.h"
+
+#define NET_PROFILE_EEPROM_ADDR 0       // 19 bytes: magic, mode, 4 addresses, checksum
+#define NET_PROFILE_MAGIC       0xA5
+
+struct NetProfile {
+    bool dhcp;
+    IPv4Config config;
+};
+
+bool setStaticIPAddress(const IPv4Config &config, bool force = false);     // IPV4_DHCP for DHCP
+bool setDHCP();
+
+bool loadNetProfile(NetProfile &profile);     // false if none was saved
+bool netProfileMatches(const IPv4Config &config);
+void forgetNetProfile();
+
+#endif /* NETCONFIG_H_ */
@@ -0,0 +1,152 @@
+/*
+ *  NetState.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "NetState.h"
+#include "Trace.h"
+
+static NetState _state;
+static volatile uint32_t _seq;          // odd while _state is being written
+static tNetappIpconfigRetArgs _config;  // ip_config as last published
+
+void ipConfigRead(tNetappIpconfigRetArgs &config)
+{
+    tNetappIpconfigRetArgs _again;
+    memcpy(&config, (const void *) &ip_config, sizeof(config));
+    for (;;) {
+        memcpy(&_again, (const void *) &ip_config, sizeof(_again));
+        if (!memcmp(&config, &_again, sizeof(config)))
+            return;
+        memcpy(&config, &_again, sizeof(config));
+    }
+}
+
+/*
+ *  The writers - the system callback and netStatePoll()
+ */
+static void beginWrite()
+{
+    _seq = _seq + 1;
+    __sync_synchronize();
+}
+
+static void endWrite()
+{
+    _state.generation = _seq + 1;
+    __sync_synchronize();
+    _seq = _seq + 1;
+}
+
+// the address part of _state from _config, inside a write
+static void setAddresses()
+{
+    _state.ip = IPv4::fromConfig(_config.aucIP);
+    _state.mask = IPv4::fromConfig(_config.aucSubnetMask);
+    _state.gateway = IPv4::fromConfig(_config.aucDefaultGateway);
+    _state.dns = IPv4::fromConfig(_config.aucDNSServer);
+    _state.dhcpServer = IPv4::fromConfig(_config.aucDHCPServer);
+    memcpy(_state.ssid, _config.uaSSID, sizeof(_config.uaSSID));
+    _state.ssid[sizeof(_config.uaSSID)] = 0;
+    _state.dnsBad = _state.dns == IPV4_BAD_DNS;
+    _state.dnsSet = _state.dns[0] || _state.dns[1];
+}
+
+static void onNetEvent(system_event_t event, int param)
+{
+    beginWrite();
+    if (event == network_status) {
+        switch (param) {
+            case network_status_on:
+                _state.powered = true;
+                break;
+            case network_status_powering_off:
+            case network_status_off:
+                _state.powered = false;
+                _state.ready = false;
+                _state.cloud = false;
+                break;
+            case network_status_connected:
+                _state.powered = true;
+                _state.ready = true;
+                break;
+            case network_status_disconnected:
+                _state.ready = false;
+                _state.cloud = false;
+                break;
+            default:
+                break;
+        }
+    } else if (event == cloud_status)
+        _state.cloud = param == cloud_status_connected;
+    traceRecord(event == network_status ? REC_NETWORK : REC_CLOUD, param);
+
+    tNetappIpconfigRetArgs _now;
+    ipConfigRead(_now);
+    traceRecordConfig(_config, _now);
+    memcpy(&_config, &_now, sizeof(_config));
+    setAddresses();
+    endWrite();
+}
+
+void netStateBegin()
+{
+    System.on(network_status | cloud_status, onNetEvent);
+    beginWrite();
+    tNetappIpconfigRetArgs _none;
+    memset(&_none, 0, sizeof(_none));
+    ipConfigRead(_config);
+    traceRecordConfig(_none, _config);  // the state the recording starts from
+    setAddresses();
+    _state.ready = WiFi.ready();
+    _state.powered = _state.ready;      // otherwise unknown until the first event, MANUAL starts off
+    _state.cloud = _state.ready && Particle.connected();
+    endWrite();
+}
+
+void netStatePoll()
+{
+    tNetappIpconfigRetArgs _now;
+    ipConfigRead(_now);
+    if (!memcmp(&_now, &_config, sizeof(_now)))
+        return;
+    beginWrite();
+    traceRecordConfig(_config, _now);
+    memcpy(&_config, &_now, sizeof(_config));
+    setAddresses();
+    endWrite();
+}
+
+/*
+ *  The readers
+ */
+void netStateRead(NetState &state)
+{
+    uint32_t _s;
+    do {
+        while ((_s = _seq) & 1)
+            ;
+        __sync_synchronize();
+        memcpy(&state, &_state, sizeof(state));
+        __sync_synchronize();
+    } while (_s != _seq);
+}
+
+uint32_t netStateGeneration()
+{
+    uint32_t _s;
+    while ((_s = _seq) & 1)
+        ;
+    return _s;
+}
+
+bool netStateChanged(uint32_t &seen)
+{
+    uint32_t _s = netStateGeneration();
+    if (_s == seen)
+        return false;
+    seen = _s;
+    return true;
+}
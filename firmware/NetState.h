@@ -0,0 +1,56 @@
+/*
+ *  NetState.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  One consistent snapshot of the CC3000, WiFi and cloud state.
+ *
+ *  The System.on() network and cloud callbacks publish the power, link and
+ *  cloud state as the system reports it, and netStatePoll() publishes the
+ *  addresses when the CC3000 changes ip_config, which it does on its own
+ *  with no event.  ip_config is copied until two reads agree, so a half
+ *  written DNS server is never published.
+ *
+ *  Publishing is a seqlock: the sequence is odd while the snapshot is being
+ *  written and moves on by two for every change.  netStateRead() copies the
+ *  snapshot and retries if the sequence was odd or moved during the copy,
+ *  so a reader never sees the link of one state with the addresses of
+ *  another.  netStateChanged() tells a reader that something changed since
+ *  it last looked, so it only has to look again then.
+ *
+ *  Addresses are IPv4 values - ip[0] is the first octet - unlike ip_config,
+ *  which holds them reversed.
+ */
+
+#ifndef NETSTATE_H_
+#define NETSTATE_H_
+
+#include <application.h>
+#include "IPv4.h"
+
+struct NetState {
+    uint32_t generation;        // changes every time the state does, never 0
+    bool powered;               // CC3000 on
+    bool ready;                 // WiFi connected with a lease
+    bool cloud;                 // cloud connected
+    bool dnsBad;                // DNS server is the TI chip bad DNS 76.83.0.0
+    bool dnsSet;                // a DNS server is set (upper octets non zero)
+    IPv4 ip;
+    IPv4 mask;
+    IPv4 gateway;
+    IPv4 dns;
+    IPv4 dhcpServer;
+    char ssid[33];
+};
+
+void netStateBegin();                   // from setup(), registers the callbacks
+void netStatePoll();                    // once per pass through loop(), publishes ip_config changes
+void netStateRead(NetState &state);     // a consistent copy
+uint32_t netStateGeneration();
+bool netStateChanged(uint32_t &seen);   // true once for each change since seen, updates seen
+
+// ip_config as the CC3000 left it, copied until two reads agree
+void ipConfigRead(tNetappIpconfigRetArgs &config);
+
+#endif /* NETSTATE_H_ */
@@ -0,0 +1,404 @@
+/*
+ *  NetTask.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "NetTask.h"
+#include "NetConfig.h"
+#include "NetState.h"
+#include "Trace.h"
+
+bool dnsIsBad()
+{
+    tNetappIpconfigRetArgs _config;
+    ipConfigRead(_config);
+    return IPv4::fromConfig(_config.aucDNSServer) == IPV4_BAD_DNS;
+}
+
+bool dnsIsSet()
+{
+    tNetappIpconfigRetArgs _config;
+    ipConfigRead(_config);
+    IPv4 _dns = IPv4::fromConfig(_config.aucDNSServer);
+    return _dns[0] != 0 || _dns[1] != 0;
+}
+
+static const char *_phaseName[] = { "disconnect  ", "DHCP reset  ", "reassociate ", "DNS good    " };
+
+void printSeconds(Print &out, uint32_t ms)
+{
+    out.print(ms / 1000);
+    out.print('.');
+    out.print((ms % 1000) / 100);
+}
+
+NetTask::NetTask(Print &out)
+    : _out(out), _op(NONE), _last(NONE), _step(S_IDLE), _stepStart(0), _timeout(0),
+      _lastProgress(0), _attempt(0), _ok(false), _fixStart(0), _goodDnsMs(0),
+      _fixes(0), _fixed(0), _recoverySum(0), _recoveryMax(0)
+{
+    _policy.attempts = FIX_DNS_ATTEMPTS;
+    _policy.backoff = FIX_DNS_BACKOFF;
+    _policy.backoffMax = FIX_DNS_BACKOFF_MAX;
+    _policy.jitter = FIX_DNS_JITTER;
+    _policy.deadline = FIX_DNS_DEADLINE;
+}
+
+void NetTask::enter(Step step, uint32_t timeout)
+{
+    _step = step;
+    _stepStart = millis();
+    // no FIX_DNS wait runs past the deadline
+    if (_op == FIX_DNS && _policy.deadline) {
+        uint32_t _used = _stepStart - _fixStart;
+        uint32_t _left = _used < _policy.deadline ? _policy.deadline - _used : 0;
+        if (timeout > _left)
+            timeout = _left;
+    }
+    _timeout = timeout;
+    _lastProgress = _stepStart - NET_PROGRESS_INTERVAL;
+}
+
+NetTask::Wait NetTask::waitFor(bool condition, char progress)
+{
+    if (condition)
+        return MET;
+    uint32_t _now = millis();
+    if (_now - _stepStart >= _timeout)
+        return TIMEOUT;
+    if (progress && _now - _lastProgress >= NET_PROGRESS_INTERVAL) {
+        _out.print(progress);
+        _lastProgress = _now;
+    }
+    return WAITING;
+}
+
+void NetTask::finish(bool ok)
+{
+    trace(TR_OP_DONE, ok);
+    _ok = ok;
+    _step = S_DONE;
+}
+
+bool NetTask::start(Op op)
+{
+    if (_op != NONE || op == NONE)
+        return false;
+    _op = op;
+    _ok = true;
+
+    switch (op) {
+        case CC3000_ON:
+            trace(TR_CC3000_ON);
+            WiFi.on();
+            enter(S_SETTLE, NET_SETTLE_TIME);
+            break;
+        case CC3000_OFF:
+            trace(TR_CC3000_OFF);
+            if (WiFi.ready()) {
+                WiFi.disconnect();
+                _out.print("Waiting for WiFi to disconnect ");
+                enter(S_LINK_DOWN);
+            } else
+                powerOff();
+            break;
+        case WIFI_CONNECT:
+            trace(TR_WIFI_CONNECT);
+            WiFi.connect();
+            _out.print("Waiting for WiFi to connect ");
+            enter(S_LINK_UP);
+            break;
+        case WIFI_DISCONNECT:
+            trace(TR_WIFI_DISCONNECT);
+            WiFi.disconnect();
+            _out.print("Waiting for WiFi to disconnect ");
+            enter(S_LINK_DOWN);
+            break;
+        case CLOUD_CONNECT:
+            trace(TR_CLOUD_CONNECT);
+            Particle.connect();
+            enter(S_CLOUD_UP);
+            break;
+        case CLOUD_DISCONNECT:
+            trace(TR_CLOUD_DISCONNECT);
+            Particle.disconnect();
+            enter(S_CLOUD_DOWN);
+            break;
+        case FIX_DNS:
+            trace(TR_FIX_DNS);
+            _attempt = 0;
+            _fixStart = millis();
+            memset(_phaseAt, 0xFF, sizeof(_phaseAt));
+            _goodDnsMs = 0;
+            _fixes++;
+            fixAttempt();
+            break;
+        default:
+            enter(S_SETTLE, NET_SETTLE_TIME);
+            break;
+    }
+    return true;
+}
+
+void NetTask::powerOff()
+{
+    WiFi.off();
+    _out.print("Waiting for CC3000 to turn off ");
+    enter(S_POWER_DOWN);
+}
+
+// CAUTION, This is aggressive and may damage the hardware
+// use at your own risk
+//
+// start with the WiFi connected to the AP
+// check if we have a bad DNS address 76.83.0.0
+// make sure the CC3000 knows we want to use DHCP
+// disconnect from the AP
+// make sure the CC3000 knows we want to use DHCP (a no-op when the profile matches)
+// reconnect to the AP
+// go to the beginning and if we still have a bad DNS IP then do it all over again.
+void NetTask::fixAttempt()
+{
+    if (_attempt >= _policy.attempts || pastDeadline()) {
+        fixDone(false);
+        return;
+    }
+    _out.print("Attempt #");
+    _out.println(++_attempt);
+    if (!WiFi.ready()) {
+        _out.println("Connecting to AP");
+        WiFi.connect();
+        _out.print("Waiting for WiFi to connect ");
+        enter(S_LINK_UP);
+    } else
+        fixCheck();
+}
+
+void NetTask::fixCheck()
+{
+    if (dnsIsSet() && !dnsIsBad()) {
+        _out.println("Success!");
+        mark(P_DNS_GOOD);
+        fixDone(true);
+    } else if (pastDeadline())
+        fixDone(false);
+    else {
+        _out.println("Resetting CC3000 to DHCP while connected");
+        setStaticIPAddress(IPV4_DHCP, true);    // rewriting NVMEM is the remedy
+        mark(P_DHCP_RESET);
+        enter(S_FIX_CONNECTED, NET_SETTLE_TIME);
+    }
+}
+
+bool NetTask::pastDeadline()
+{
+    return _policy.deadline && millis() - _fixStart >= _policy.deadline;
+}
+
+/*
+ *  base * 2^(attempt - 1), capped, +/- jitter percent
+ */
+uint32_t NetTask::backoff()
+{
+    uint32_t _ms = _policy.backoff;
+    for (uint8_t i = 1; i < _attempt && _ms < _policy.backoffMax; i++)
+        _ms <<= 1;
+    if (_ms > _policy.backoffMax)
+        _ms = _policy.backoffMax;
+    long _spread = (long) _ms * _policy.jitter / 100;
+    return _ms + random(-_spread, _spread + 1);
+}
+
+void NetTask::fixDone(bool ok)
+{
+    uint32_t _elapsed = millis() - _fixStart;
+
+    _out.println("Fix DNS timeline - s since start");
+    for (uint8_t i = 0; i < P_COUNT; i++) {
+        _out.print("   ");
+        _out.print(_phaseName[i]);
+        if (_phaseAt[i] == 0xFFFFFFFF)
+            _out.println("-");
+        else {
+            printSeconds(_out, _phaseAt[i]);
+            _out.println();
+        }
+    }
+    if (ok) {
+        _goodDnsMs = _phaseAt[P_DNS_GOOD];
+        _fixed++;
+        _recoverySum += _goodDnsMs;
+        if (_goodDnsMs > _recoveryMax)
+            _recoveryMax = _goodDnsMs;
+        _out.print("Time to good DNS ");
+        printSeconds(_out, _goodDnsMs);
+    } else {
+        _out.print(pastDeadline() ? "Deadline reached, no good DNS after " : "No good DNS after ");
+        printSeconds(_out, _elapsed);
+    }
+    _out.print(" s, ");
+    _out.print(_attempt);
+    _out.println(_attempt == 1 ? " attempt" : " attempts");
+    printFixStats(_out);
+    finish(ok);
+}
+
+void NetTask::printFixStats(Print &out)
+{
+    out.print("Fix DNS runs ");
+    out.print(_fixes);
+    out.print("  recovered ");
+    out.print(_fixed);
+    if (_fixed) {
+        out.print("  mean ");
+        printSeconds(out, _recoverySum / _fixed);
+        out.print(" s  max ");
+        printSeconds(out, _recoveryMax);
+        out.print(" s");
+    }
+    out.println();
+}
+
+bool NetTask::run()
+{
+    Wait _w = WAITING;
+
+    switch (_step) {
+        case S_LINK_UP:
+            if ((_w = waitFor(WiFi.ready(), '+')) == WAITING)
+                break;
+            if (_w == TIMEOUT) {
+                _out.print("Failed to connect to WiFi router - credentials ");
+                _out.println(WiFi.hasCredentials() ? "known" : "unknown");
+                _ok = false;
+                if (_op == FIX_DNS) {
+                    fixDone(false);
+                    break;
+                }
+            } else if (_op == FIX_DNS) {
+                mark(P_REASSOCIATE);
+                enter(S_DNS_SET);
+                break;
+            } else
+                _out.println();
+            enter(S_SETTLE, NET_SETTLE_TIME);
+            break;
+
+        case S_DNS_SET:
+            if ((_w = waitFor(dnsIsSet(), '-')) == WAITING)
+                break;
+            if (_w == TIMEOUT) {
+                // no DNS server at all - a failed attempt, retried or past the deadline
+                _out.println();
+                _out.println("No DNS server from DHCP");
+                fixCheck();
+            } else
+                enter(S_DNS_GOOD, FIX_DNS_BAD_WAIT);
+            break;
+
+        case S_DNS_GOOD:
+            if (waitFor(!dnsIsBad(), '*') == WAITING)
+                break;
+            _out.println();
+            fixCheck();
+            break;
+
+        case S_FIX_CONNECTED:
+            if (waitFor(false) == WAITING)
+                break;
+            _out.println("Disconnecting from AP");
+            WiFi.disconnect();
+            _out.print("Waiting for WiFi to disconnect ");
+            enter(S_LINK_DOWN);
+            break;
+
+        case S_LINK_DOWN:
+            if ((_w = waitFor(!WiFi.ready(), '-')) == WAITING)
+                break;
+            if (_op == FIX_DNS && _w == MET)
+                mark(P_DISCONNECT);
+            enter(S_DNS_CLEAR);
+            break;
+
+        case S_DNS_CLEAR:
+            if (waitFor(!dnsIsSet(), '-') == WAITING)
+                break;
+            _out.println();
+            if (_op == CC3000_OFF)
+                powerOff();
+            else if (_op == FIX_DNS) {
+                uint32_t _wait = 0;
+                if (netProfileMatches(IPV4_DHCP))
+                    _out.println("CC3000 already set to DHCP");   // just written while connected
+                else {
+                    _out.println("Resetting CC3000 to DHCP while not connected");
+                    setStaticIPAddress(IPV4_DHCP);
+                    mark(P_DHCP_RESET);
+                    _wait = NET_SETTLE_TIME;
+                }
+                if (_attempt < _policy.attempts) {
+                    uint32_t _backoff = backoff();
+                    if (_backoff > _wait)
+                        _wait = _backoff;
+                    _out.print("Backing off ");
+                    printSeconds(_out, _wait);
+                    _out.println(" s");
+                }
+                enter(S_FIX_DISCONNECTED, _wait);
+            } else
+                enter(S_SETTLE, NET_SETTLE_TIME);
+            break;
+
+        case S_FIX_DISCONNECTED:
+            if (waitFor(false) != WAITING)
+                fixAttempt();
+            break;
+
+        case S_POWER_DOWN:
+            if (waitFor(!WiFi.ready(), '-') != WAITING)
+                enter(S_POWER_CLEAR);
+            break;
+
+        case S_POWER_CLEAR:
+            if (waitFor(!dnsIsSet(), '+') != WAITING)
+                enter(S_SETTLE, NET_SETTLE_TIME);
+            break;
+
+        case S_CLOUD_UP:
+            if ((_w = waitFor(Particle.connected(), '+')) == WAITING)
+                break;
+            if (_w == TIMEOUT)
+                _out.println("Failed to connect to Spark Cloud.");
+            else
+                _out.println();
+            finish(_w == MET);
+            break;
+
+        case S_CLOUD_DOWN:
+            if ((_w = waitFor(!Particle.connected(), '-')) == WAITING)
+                break;
+            if (_w == TIMEOUT)
+                _out.println("Failed to disconnect from cloud");
+            else
+                _out.println();
+            finish(_w == MET);
+            break;
+
+        case S_SETTLE:
+            if (waitFor(false) != WAITING)
+                finish(_ok);
+            break;
+
+        default:
+            break;
+    }
+
+    if (_step != S_DONE)
+        return false;
+    _last = _op;
+    _op = NONE;
+    _step = S_IDLE;
+    return true;
+}
@@ -0,0 +1,129 @@
+/*
+ *  NetTask.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Non-blocking CC3000 / WiFi / Cloud transitions.
+ *
+ *  A transition is started with start() and then advanced by calling run()
+ *  once per pass through loop().  Each step checks its condition, prints a
+ *  progress character every NET_PROGRESS_INTERVAL ms while it waits and gives
+ *  up after its own millis() deadline, so nothing ever spins in delay() and
+ *  the console and Particle.process() keep running.
+ *
+ *  FIX_DNS backs off between attempts - exponentially, with jitter so a
+ *  fleet reset together does not hit the access point together - and gives
+ *  up at an overall deadline.  It timestamps the disconnect, DHCP reset,
+ *  reassociation and good DNS phases and reports the time to good DNS.
+ */
+
+#ifndef NETTASK_H_
+#define NETTASK_H_
+
+#include <application.h>
+
+#define NET_WAIT_TIMEOUT        10000   // ms to wait for WiFi / cloud / DNS to change state
+#define NET_SETTLE_TIME         500     // ms to let the CC3000 settle after a change
+#define NET_PROGRESS_INTERVAL   100     // ms between progress characters
+#define FIX_DNS_ATTEMPTS        5       // attempts by FIX_DNS to get a good DNS server
+#define FIX_DNS_BAD_WAIT        5000    // ms FIX_DNS waits for a bad DNS server to be replaced
+#define FIX_DNS_BACKOFF         500     // ms before the second attempt, doubled for each one after
+#define FIX_DNS_BACKOFF_MAX     8000    // ms
+#define FIX_DNS_JITTER          25      // +/- percent of the backoff
+#define FIX_DNS_DEADLINE        120000  // ms for the whole fix
+
+struct FixDnsPolicy {
+    uint8_t attempts;
+    uint16_t backoff;           // ms
+    uint16_t backoffMax;        // ms
+    uint8_t jitter;             // percent
+    uint32_t deadline;          // ms, 0 = none
+};
+
+class NetTask {
+public:
+    enum Op {
+        NONE,
+        CC3000_ON,
+        CC3000_OFF,
+        WIFI_CONNECT,
+        WIFI_DISCONNECT,
+        CLOUD_CONNECT,
+        CLOUD_DISCONNECT,
+        FIX_DNS,
+        SETTLE
+    };
+
+    NetTask(Print &out = Serial);       // progress and messages go to out
+
+    bool start(Op op);                  // false if a transition is already running
+    bool run();                         // true once, when the transition completes
+    bool busy() const { return _op != NONE; }
+    Op op() const { return _op; }
+    Op lastOp() const { return _last; }
+    bool succeeded() const { return _ok; }
+
+    void setFixDnsPolicy(const FixDnsPolicy &policy) { _policy = policy; }
+    const FixDnsPolicy &fixDnsPolicy() const { return _policy; }
+    uint32_t timeToGoodDns() const { return _goodDnsMs; }  // ms, last FIX_DNS, 0 if it failed
+    void printFixStats(Print &out);
+
+private:
+    enum Step {
+        S_IDLE,
+        S_LINK_UP,          // wait for WiFi.ready()
+        S_LINK_DOWN,        // wait for !WiFi.ready()
+        S_DNS_CLEAR,        // wait for ip_config to be cleared after a disconnect
+        S_DNS_SET,          // FIX_DNS, wait for the DHCP DNS server to show up in ip_config
+        S_DNS_GOOD,         // FIX_DNS, wait while the DNS server is 76.83.0.0
+        S_FIX_CONNECTED,    // FIX_DNS, settle after the DHCP reset while connected
+        S_FIX_DISCONNECTED, // FIX_DNS, back off after the DHCP reset while not connected
+        S_POWER_DOWN,       // CC3000_OFF, wait for the radio to drop
+        S_POWER_CLEAR,      // CC3000_OFF, wait for ip_config to be cleared
+        S_CLOUD_UP,
+        S_CLOUD_DOWN,
+        S_SETTLE,
+        S_DONE
+    };
+
+    enum Wait { WAITING, MET, TIMEOUT };
+
+    enum Phase { P_DISCONNECT, P_DHCP_RESET, P_REASSOCIATE, P_DNS_GOOD, P_COUNT };
+
+    void enter(Step step, uint32_t timeout = NET_WAIT_TIMEOUT);
+    Wait waitFor(bool condition, char progress = 0);
+    void finish(bool ok);
+    void powerOff();
+    void fixAttempt();
+    void fixCheck();
+    void fixDone(bool ok);
+    bool pastDeadline();
+    void mark(Phase phase) { _phaseAt[phase] = millis() - _fixStart; }
+    uint32_t backoff();
+
+    Print &_out;
+    Op _op;
+    Op _last;
+    Step _step;
+    uint32_t _stepStart;
+    uint32_t _timeout;
+    uint32_t _lastProgress;
+    uint8_t _attempt;
+    bool _ok;
+
+    FixDnsPolicy _policy;
+    uint32_t _fixStart;
+    uint32_t _phaseAt[P_COUNT];         // ms since _fixStart, the latest of each phase
+    uint32_t _goodDnsMs;
+    uint16_t _fixes;
+    uint16_t _fixed;
+    uint32_t _recoverySum;              // ms, over the fixes that succeeded
+    uint32_t _recoveryMax;
+};
+
+bool dnsIsBad();        // ip_config holds the TI chip bad DNS 76.83.0.0
+bool dnsIsSet();        // ip_config holds a DNS server (upper octets non zero)
+void printSeconds(Print &out, uint32_t ms);     // ms as seconds "12.3"
+
+#endif /* NETTASK_H_ */
@@ -0,0 +1,173 @@
+/*
+ *  Probe.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "Probe.h"
+#include "SerialOut.h"
+#include "Trace.h"
+
+static const char *_statusName[] = { "pending", "ok", "no connect", "no response" };
+
+Probe::Probe(const char * const *hosts, uint8_t count, Print &out)
+    : _out(out), _hosts(hosts), _cache(NULL), _hostCount(count < PROBE_MAX_HOSTS ? count : PROBE_MAX_HOSTS),
+      _next(count), _inFlight(0), _start(0), _elapsedMs(0)
+{
+    for (uint8_t i = 0; i < PROBE_SOCKETS; i++)
+        _slot[i].step = S_FREE;
+}
+
+bool Probe::start(DnsCache *cache)
+{
+    if (busy() || !_hostCount)
+        return false;
+    _cache = cache;
+    _next = 0;
+    _start = millis();
+    _elapsedMs = 0;
+    memset(_result, 0, sizeof(_result));
+    _out.print("Probe ");
+    _out.print(_hostCount);
+    _out.print(" hosts, ");
+    _out.print(_hostCount < PROBE_SOCKETS ? _hostCount : PROBE_SOCKETS);
+    _out.println(" at a time");
+    return true;
+}
+
+void Probe::stop()
+{
+    for (uint8_t i = 0; i < PROBE_SOCKETS; i++)
+        if (_slot[i].step != S_FREE)
+            close(_slot[i], NO_RESPONSE);
+    _next = _hostCount;
+}
+
+uint8_t Probe::failures() const
+{
+    uint8_t _n = 0;
+    for (uint8_t i = 0; i < _hostCount; i++)
+        if (_result[i].status != OK)
+            _n++;
+    return _n;
+}
+
+/*
+ *  The blocking part - resolve and connect one host
+ */
+void Probe::open(Slot &slot)
+{
+    slot.host = _next++;
+    Result &_r = _result[slot.host];
+    const char *_host = _hosts[slot.host];
+    uint32_t _t = millis();
+    int _ok = _cache ? _cache->connect(slot.client, _host, PROBE_PORT)
+                     : slot.client.connect(_host, PROBE_PORT);
+    _r.connectMs = millis() - _t;
+    if (!_ok) {
+        slot.client.stop();
+        _r.status = NO_CONNECT;
+        _out.print('x');
+        return;
+    }
+    slot.step = S_CONNECTING;
+    slot.stepStart = millis();
+    _inFlight++;
+}
+
+void Probe::service(Slot &slot)
+{
+    uint32_t _now = millis();
+    int _n;
+    switch (slot.step) {
+        case S_CONNECTING:
+            if (slot.client.connected()) {
+                slot.client.print("GET / HTTP/1.1\r\nHost: ");
+                slot.client.print(_hosts[slot.host]);
+                slot.client.print("\r\nConnection: close\r\n\r\n");
+                slot.step = S_WAITING;
+                slot.stepStart = _now;
+            } else if (_now - slot.stepStart >= PROBE_CONNECT_TIMEOUT)
+                close(slot, NO_CONNECT);
+            break;
+        case S_WAITING:
+            if ((_n = slot.client.available())) {
+                trace(TR_FIRST_BYTE, _n);
+                _result[slot.host].firstByteMs = _now - slot.stepStart;
+                close(slot, OK);
+            } else if (_now - slot.stepStart >= PROBE_RESPONSE_TIMEOUT)
+                close(slot, NO_RESPONSE);
+            break;
+        default:
+            break;
+    }
+}
+
+void Probe::close(Slot &slot, Status status)
+{
+    slot.client.stop();
+    slot.step = S_FREE;
+    _inFlight--;
+    _result[slot.host].status = status;
+    _out.print(status == OK ? '.' : 'x');
+}
+
+bool Probe::run()
+{
+    if (!busy())
+        return false;
+
+    // the waits first, they cost nothing
+    for (uint8_t i = 0; i < PROBE_SOCKETS; i++)
+        service(_slot[i]);
+
+    // then at most one connect
+    if (_next < _hostCount && WiFi.ready()) {
+        for (uint8_t i = 0; i < PROBE_SOCKETS; i++)
+            if (_slot[i].step == S_FREE) {
+                open(_slot[i]);
+                break;
+            }
+    } else if (!WiFi.ready())
+        while (_next < _hostCount)
+            _result[_next++].status = NO_CONNECT;
+
+    if (busy())
+        return false;
+    _elapsedMs = millis() - _start;
+    _out.println();
+    report(_out);
+    return true;
+}
+
+void Probe::report(Print &out)
+{
+    uint32_t _sum = 0;
+    out.println("   host                 result      connect  first byte ms");
+    for (uint8_t i = 0; i < _hostCount; i++) {
+        const Result &_r = _result[i];
+        const char *_host = _hosts[i];
+        uint8_t _len = strlen(_host);
+        out.print("   ");
+        out.print(_host);
+        for (; _len < 21; _len++)
+            out.print(' ');
+        out.print(_statusName[_r.status]);
+        for (_len = strlen(_statusName[_r.status]); _len < 11; _len++)
+            out.print(' ');
+        printRight(out, _r.connectMs, 8);
+        printRight(out, _r.firstByteMs, 12);
+        out.println();
+        _sum += _r.connectMs + _r.firstByteMs;
+    }
+    out.print("Probe ");
+    out.print(_hostCount - failures());
+    out.print('/');
+    out.print(_hostCount);
+    out.print(" ok in ");
+    out.print(_elapsedMs);
+    out.print(" ms, one at a time about ");
+    out.print(_sum);
+    out.println(" ms");
+}
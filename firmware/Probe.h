@@ -0,0 +1,81 @@
+/*
+ *  Probe.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Connectivity probe of several hosts at once.
+ *
+ *  Each host gets its own TCPClient stepping through connect, send and wait
+ *  for the first byte of the response, once per pass through loop(), with up
+ *  to PROBE_SOCKETS in flight.  The CC3000 connect() itself blocks, so one
+ *  socket connects per pass while the others wait for their servers; a
+ *  probe of several hosts takes about as long as the slowest one instead of
+ *  all of them added together.
+ *
+ *  The CC3000 has 7 sockets - PROBE_SOCKETS leaves one for the cloud and one
+ *  for the UDP resolver.
+ */
+
+#ifndef PROBE_H_
+#define PROBE_H_
+
+#include <application.h>
+#include "DnsCache.h"
+
+#define PROBE_SOCKETS           5       // in flight at once
+#define PROBE_MAX_HOSTS         8
+#define PROBE_PORT              80
+#define PROBE_CONNECT_TIMEOUT   1000    // ms for connected() after connect()
+#define PROBE_RESPONSE_TIMEOUT  10000   // ms for the first byte after the request
+
+class Probe {
+public:
+    enum Status { PENDING, OK, NO_CONNECT, NO_RESPONSE };
+
+    struct Result {
+        Status status;
+        uint16_t connectMs;     // resolve and connect
+        uint16_t firstByteMs;   // request sent to the first byte
+    };
+
+    Probe(const char * const *hosts, uint8_t count, Print &out = Serial);
+
+    // Names are looked up through cache when one is given, else by the CC3000
+    bool start(DnsCache *cache = NULL);
+    bool run();                         // true once, when every host has a result
+    void stop();
+    bool busy() const { return _next < _hostCount || _inFlight; }
+
+    const Result &result(uint8_t host) const { return _result[host]; }
+    uint8_t failures() const;
+    uint32_t elapsedMs() const { return _elapsedMs; }
+    void report(Print &out);
+
+private:
+    enum Step { S_FREE, S_CONNECTING, S_WAITING };
+
+    struct Slot {
+        TCPClient client;
+        Step step;
+        uint8_t host;
+        uint32_t stepStart;
+    };
+
+    void open(Slot &slot);
+    void service(Slot &slot);
+    void close(Slot &slot, Status status);
+
+    Print &_out;
+    const char * const *_hosts;
+    DnsCache *_cache;
+    uint8_t _hostCount;
+    uint8_t _next;                      // next host to connect
+    uint8_t _inFlight;
+    uint32_t _start;
+    uint32_t _elapsedMs;
+    Slot _slot[PROBE_SOCKETS];
+    Result _result[PROBE_MAX_HOSTS];
+};
+
+#endif /* PROBE_H_ */
@@ -0,0 +1,221 @@
+/*
+ *  SerialOut.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "SerialOut.h"
+
+static uint8_t _ring[SERIAL_OUT_SIZE];
+
+SerialOut serialOut;
+
+SerialOut::SerialOut()
+    : _head(0), _count(0), _bytes(0), _writes(0), _writeUs(0), _blockedUs(0),
+      _maxPending(0), _renderStart(0), _renderBytes(0), _lastRenderBytes(0), _lastRenderUs(0)
+{
+}
+
+size_t SerialOut::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t SerialOut::write(const uint8_t *buffer, size_t size)
+{
+    size_t _n = size;
+    while (size) {
+        if (!room()) {
+            uint32_t _start = micros();
+            send(true);
+            _blockedUs += micros() - _start;
+        }
+        uint16_t _tail = (_head + _count) % SERIAL_OUT_SIZE;
+        uint16_t _chunk = SERIAL_OUT_SIZE - _tail;
+        if (_chunk > room())
+            _chunk = room();
+        if (_chunk > size)
+            _chunk = size;
+        memcpy(_ring + _tail, buffer, _chunk);
+        _count += _chunk;
+        buffer += _chunk;
+        size -= _chunk;
+    }
+    _bytes += _n;
+    if (_count > _maxPending)
+        _maxPending = _count;
+    return _n;
+}
+
+/*
+ *  Hand the driver the bytes up to the end of the ring, or only what fits
+ *  in its transmit buffer unless block is set
+ */
+void SerialOut::send(bool block)
+{
+    uint16_t _n = SERIAL_OUT_SIZE - _head;
+    if (_n > _count)
+        _n = _count;
+    if (!block) {
+        int _free = Serial.availableForWrite();
+        if (_free <= 0 || (_free < _n && _free < SERIAL_OUT_MIN_WRITE))
+            return;
+        if (_n > _free)
+            _n = _free;
+    }
+    if (!_n)
+        return;
+    uint32_t _start = micros();
+    Serial.write(_ring + _head, _n);
+    _writeUs += micros() - _start;
+    _writes++;
+    _head = (_head + _n) % SERIAL_OUT_SIZE;
+    _count -= _n;
+}
+
+void SerialOut::service()
+{
+    send(false);
+}
+
+void SerialOut::flush()
+{
+    while (_count)
+        send(true);
+}
+
+void SerialOut::cell(const char *text, uint8_t width)
+{
+    static const char _spaces[] = "                                ";
+    uint8_t _len = strlen(text);
+    write((const uint8_t *) text, _len);
+    while (_len < width) {
+        uint8_t _pad = width - _len < (int) sizeof(_spaces) - 1 ? width - _len : sizeof(_spaces) - 1;
+        write((const uint8_t *) _spaces, _pad);
+        _len += _pad;
+    }
+}
+
+void SerialOut::beginRender()
+{
+    _renderStart = micros();
+    _renderBytes = _bytes;
+}
+
+void SerialOut::endRender()
+{
+    _lastRenderUs = micros() - _renderStart;
+    _lastRenderBytes = _bytes - _renderBytes;
+}
+
+void SerialOut::printStats(Print &out)
+{
+    out.print("Output ");
+    out.print(_bytes);
+    out.print(" bytes in ");
+    out.print(_writes);
+    out.print(" writes, ");
+    out.print(_writeUs / 1000);
+    out.print(" ms in Serial.write, ");
+    out.print(_blockedUs / 1000);
+    out.println(" ms waiting for room");
+    out.print("Ring ");
+    out.print(SERIAL_OUT_SIZE);
+    out.print(" bytes, max pending ");
+    out.print(_maxPending);
+    out.print("  last render ");
+    out.print(_lastRenderBytes);
+    out.print(" bytes in ");
+    out.print(_lastRenderUs);
+    out.println(" us");
+}
+
+/*
+ *  Formatting
+ */
+static char *putDecimal(char *p, uint32_t value)
+{
+    char _digits[10];
+    uint8_t _n = 0;
+    do {
+        _digits[_n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (_n)
+        *p++ = _digits[--_n];
+    return p;
+}
+
+static const char _hexDigit[] = "0123456789abcdef";
+static const uint8_t _octetPlace[] = { 100, 10 };
+
+// One octet, at most 3 digits, by subtracting places instead of dividing
+static char *putOctet(char *p, uint8_t value)
+{
+    bool _lead = true;
+    for (uint8_t i = 0; i < sizeof(_octetPlace); i++) {
+        char _d = '0';
+        while (value >= _octetPlace[i]) {
+            value -= _octetPlace[i];
+            _d++;
+        }
+        if (_d != '0' || !_lead) {
+            *p++ = _d;
+            _lead = false;
+        }
+    }
+    *p++ = '0' + value;
+    return p;
+}
+
+uint8_t formatIPv4(char *buf, const uint8_t *ip)
+{
+    char *_p = putOctet(buf, ip[0]);
+    for (uint8_t i = 1; i < 4; i++) {
+        *_p++ = '.';
+        _p = putOctet(_p, ip[i]);
+    }
+    *_p = 0;
+    return _p - buf;
+}
+
+uint8_t formatIPv4(char *buf, IPv4 ip)
+{
+    uint8_t _octets[4] = { ip[0], ip[1], ip[2], ip[3] };
+    return formatIPv4(buf, _octets);
+}
+
+uint8_t formatMac(char *buf, const uint8_t *mac, bool reverse)
+{
+    char *_p = buf;
+    for (uint8_t i = 0; i < 6; i++) {
+        uint8_t _b = mac[reverse ? 5 - i : i];
+        if (i)
+            *_p++ = ':';
+        *_p++ = _hexDigit[_b >> 4];
+        *_p++ = _hexDigit[_b & 0x0F];
+    }
+    *_p = 0;
+    return _p - buf;
+}
+
+uint8_t formatInt(char *buf, long value)
+{
+    char *_p = buf;
+    if (value < 0) {
+        *_p++ = '-';
+        _p = putDecimal(_p, -(unsigned long) value);
+    } else
+        _p = putDecimal(_p, value);
+    *_p = 0;
+    return _p - buf;
+}
+
+void printRight(Print &out, long value, uint8_t width)
+{
+    char _buf[12];
+    for (uint8_t _len = formatInt(_buf, value); _len < width; _len++)
+        out.print(' ');
+    out.print(_buf);
+}
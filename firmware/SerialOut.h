@@ -0,0 +1,92 @@
+/*
+ *  SerialOut.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Buffered console output.
+ *
+ *  Text is composed through the usual Print interface into a static ring
+ *  buffer.  service(), called once per pass through loop(), hands the serial
+ *  driver one write of as much as it can take without blocking, so a status
+ *  table or the menu is rendered at once and then drains in the background.
+ *  All console output goes through the same ring, so progress characters
+ *  never cut into a table.  Only when the ring itself is full does a write
+ *  wait for the driver.
+ *
+ *  Also fixed width cells and IPv4 / MAC formatting without sprintf.
+ */
+
+#ifndef SERIALOUT_H_
+#define SERIALOUT_H_
+
+#include <application.h>
+#include "IPv4.h"
+
+#define SERIAL_OUT_SIZE     2048    // bytes, the status table and the largest menu (1400) with room
+#define SERIAL_OUT_MIN_WRITE 16     // bytes, fewer driver calls while it drains
+
+class SerialOut : public Print {
+public:
+    SerialOut();
+
+    virtual size_t write(uint8_t c);
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+
+    void service();                     // one non-blocking write to the driver
+    void flush();                       // wait until everything is out
+    uint16_t pending() const { return _count; }
+
+    // text left aligned and padded with spaces to width
+    void cell(const char *text, uint8_t width);
+
+    // Measure one rendering - bytes composed and microseconds spent
+    void beginRender();
+    void endRender();
+
+    void printStats(Print &out);
+
+private:
+    uint16_t room() const { return SERIAL_OUT_SIZE - _count; }
+    void send(bool block);
+
+    uint16_t _head;                     // next byte to send
+    uint16_t _count;
+    uint32_t _bytes;                    // composed since start
+    uint32_t _writes;                   // Serial.write calls
+    uint32_t _writeUs;                  // spent in Serial.write
+    uint32_t _blockedUs;                // spent waiting for room in the ring
+    uint16_t _maxPending;
+    uint32_t _renderStart;
+    uint32_t _renderBytes;
+    uint16_t _lastRenderBytes;
+    uint32_t _lastRenderUs;
+};
+
+// Forwards to another Print unless muted - detail that batch mode hides
+class GatedPrint : public Print {
+public:
+    GatedPrint(Print &out) : _out(out), _muted(false) { }
+
+    void mute(bool muted) { _muted = muted; }
+    virtual size_t write(uint8_t c) { return _muted ? 1 : _out.write(c); }
+    virtual size_t write(const uint8_t *buffer, size_t size) { return _muted ? size : _out.write(buffer, size); }
+    using Print::write;
+
+private:
+    Print &_out;
+    bool _muted;
+};
+
+// Format into buf, NUL terminated, return the length
+uint8_t formatIPv4(char *buf, const uint8_t *ip);                   // 16 bytes
+uint8_t formatIPv4(char *buf, IPv4 ip);
+uint8_t formatMac(char *buf, const uint8_t *mac, bool reverse);     // 18 bytes
+uint8_t formatInt(char *buf, long value);                           // 12 bytes
+
+void printRight(Print &out, long value, uint8_t width);             // padded on the left
+
+extern SerialOut serialOut;
+
+#endif /* SERIALOUT_H_ */
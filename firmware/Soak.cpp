@@ -0,0 +1,284 @@
+/*
+ *  Soak.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "Soak.h"
+#include "IPv4.h"
+#include "NetState.h"
+#include "NetTask.h"
+#include "SerialOut.h"
+#include "Trace.h"
+
+static SoakRecord _log[SOAK_LOG_SIZE];
+static uint16_t _logged;                // records since the run started
+static uint16_t _sorted[SOAK_LOG_SIZE]; // scratch for the percentiles
+
+Soak::Soak(Print &out)
+    : _out(out), _mode(WIFI), _test(NULL), _step(S_IDLE), _stepStart(0), _timeout(0),
+      _connectAt(0), _readyAt(0), _runStart(0), _runMs(0), _cycles(0), _done(0),
+      _noLink(0), _noDns(0), _badDns(0), _tested(0), _testFailed(0)
+{
+}
+
+void Soak::enter(Step step, uint32_t timeout)
+{
+    _step = step;
+    _stepStart = millis();
+    _timeout = timeout;
+}
+
+bool Soak::start(Mode mode, uint16_t cycles, bool (*test)())
+{
+    if (_step != S_IDLE || !cycles)
+        return false;
+    _mode = mode;
+    _cycles = cycles;
+    _test = test;
+    _done = 0;
+    _logged = 0;
+    _noLink = _noDns = _badDns = _tested = _testFailed = 0;
+    _runStart = millis();
+    _runMs = 0;
+    _out.print("Soak ");
+    _out.print(_cycles);
+    _out.println(_mode == WIFI ? " WiFi disconnect / connect cycles" : " CC3000 off / on cycles");
+    beginCycle();
+    return true;
+}
+
+void Soak::stop()
+{
+    if (_step == S_IDLE)
+        return;
+    _cycles = _done;
+    _runMs = millis() - _runStart;
+    _step = S_IDLE;
+}
+
+void Soak::beginCycle()
+{
+    memset(&_cur, 0, sizeof(_cur));
+    if (_mode == POWER) {
+        trace(TR_CC3000_OFF);
+        WiFi.off();
+    } else {
+        trace(TR_WIFI_DISCONNECT);
+        WiFi.disconnect();
+    }
+    enter(S_DOWN, SOAK_WAIT_TIMEOUT);
+}
+
+void Soak::connect()
+{
+    if (_mode == POWER) {
+        trace(TR_CC3000_ON);
+        WiFi.on();
+    }
+    trace(TR_WIFI_CONNECT);
+    WiFi.connect();
+    _connectAt = millis();
+    enter(S_ASSOC, SOAK_WAIT_TIMEOUT);
+}
+
+void Soak::endCycle(uint8_t flags)
+{
+    _cur.flags |= flags;
+    if (!(_cur.flags & (SOAK_NO_LINK | SOAK_NO_DNS)) && _test) {
+        _cur.flags |= SOAK_TESTED;
+        serialOut.flush();                  // the test blocks
+        uint32_t _start = millis();
+        if (_test())
+            _cur.flags |= SOAK_TEST_OK;
+        _cur.testMs = clampMs(millis() - _start);
+    }
+
+    if (_cur.flags & SOAK_NO_LINK)
+        _noLink++;
+    if (_cur.flags & SOAK_NO_DNS)
+        _noDns++;
+    if (_cur.flags & SOAK_BAD_DNS)
+        _badDns++;
+    if (_cur.flags & SOAK_TESTED) {
+        _tested++;
+        if (!(_cur.flags & SOAK_TEST_OK))
+            _testFailed++;
+    }
+    _log[_logged++ % SOAK_LOG_SIZE] = _cur;
+    if (_logged == 2 * SOAK_LOG_SIZE)
+        _logged = SOAK_LOG_SIZE;            // keep the count from wrapping
+
+    // one character per cycle, a line every 50
+    char _c = _cur.flags & SOAK_NO_LINK ? '!' : _cur.flags & SOAK_NO_DNS ? '?' :
+              _cur.flags & SOAK_BAD_DNS ? 'x' :
+              (_cur.flags & SOAK_TESTED) && !(_cur.flags & SOAK_TEST_OK) ? 'f' : '.';
+    _out.print(_c);
+    if (++_done % 50 == 0 || _done == _cycles)
+        _out.println();
+    enter(S_PAUSE, SOAK_PAUSE);
+}
+
+bool Soak::run()
+{
+    switch (_step) {
+        case S_IDLE:
+            return false;
+
+        case S_DOWN:
+            if ((!WiFi.ready() && !dnsIsSet()) || expired())
+                connect();
+            break;
+
+        case S_ASSOC:
+            if (WiFi.ready()) {
+                _readyAt = millis();
+                _cur.assocMs = clampMs(_readyAt - _connectAt);
+                enter(S_DHCP, SOAK_WAIT_TIMEOUT);
+            } else if (expired()) {
+                _cur.assocMs = clampMs(millis() - _connectAt);
+                endCycle(SOAK_NO_LINK);
+            }
+            break;
+
+        case S_DHCP:
+            if (dnsIsSet()) {
+                _cur.dhcpMs = clampMs(millis() - _readyAt);
+                enter(S_DNS_GOOD, FIX_DNS_BAD_WAIT);
+            } else if (expired()) {
+                _cur.dhcpMs = clampMs(millis() - _readyAt);
+                endCycle(SOAK_NO_DNS);
+            }
+            break;
+
+        case S_DNS_GOOD: {
+            // the address logged and the verdict from the same copy
+            tNetappIpconfigRetArgs _config;
+            ipConfigRead(_config);
+            IPv4 _dns = IPv4::fromConfig(_config.aucDNSServer);
+            bool _bad = _dns == IPV4_BAD_DNS;
+            if (!_bad || expired()) {
+                for (uint8_t i = 0; i < 4; i++)
+                    _cur.dns[i] = _dns[i];
+                endCycle(_bad ? SOAK_BAD_DNS : 0);
+            }
+            break;
+        }
+
+        case S_PAUSE:
+            if (!expired())
+                break;
+            if (_done < _cycles) {
+                beginCycle();
+                break;
+            }
+            _runMs = millis() - _runStart;
+            _step = S_IDLE;
+            return true;
+    }
+    return false;
+}
+
+static void printRate(Print &out, const char *label, uint16_t n, uint16_t of)
+{
+    out.print(label);
+    printRight(out, n, 6);
+    out.print("  ");
+    uint32_t _permille = of ? (uint32_t) n * 1000 / of : 0;
+    out.print(_permille / 10);
+    out.print('.');
+    out.print(_permille % 10);
+    out.println('%');
+}
+
+// exact percentile of the first n entries of _sorted
+static uint16_t percentile(uint16_t n, uint8_t pct)
+{
+    uint16_t _rank = ((uint32_t) n * pct + 99) / 100;
+    return _sorted[_rank ? _rank - 1 : 0];
+}
+
+static void printPercentiles(Print &out, const char *label, uint16_t n)
+{
+    // insertion sort, n <= SOAK_LOG_SIZE
+    for (uint16_t i = 1; i < n; i++) {
+        uint16_t _v = _sorted[i];
+        uint16_t j = i;
+        for (; j && _sorted[j - 1] > _v; j--)
+            _sorted[j] = _sorted[j - 1];
+        _sorted[j] = _v;
+    }
+    out.print(label);
+    static const uint8_t _pct[] = { 50, 95, 99 };
+    for (uint8_t i = 0; i < sizeof(_pct); i++)
+        printRight(out, n ? percentile(n, _pct[i]) : 0, 7);
+    printRight(out, n ? _sorted[n - 1] : 0, 7);
+    out.println();
+}
+
+void Soak::report(Print &out)
+{
+    out.print("Soak ");
+    out.print(_done);
+    out.print(" of ");
+    out.print(_cycles);
+    out.print(_mode == WIFI ? " WiFi cycles in " : " CC3000 cycles in ");
+    uint32_t _ms = _step == S_IDLE ? _runMs : millis() - _runStart;
+    printSeconds(out, _ms);
+    out.println(" s");
+    printRate(out, "   no link     ", _noLink, _done);
+    printRate(out, "   no DNS      ", _noDns, _done);
+    printRate(out, "   bad DNS     ", _badDns, _done);
+    printRate(out, "   test failed ", _testFailed, _tested);
+
+    uint16_t _n = _logged < SOAK_LOG_SIZE ? _logged : SOAK_LOG_SIZE;
+    out.print("Last ");
+    out.print(_n);
+    out.println(" cycles");
+    out.println("   ms                  p50    p95    p99    max");
+
+    uint16_t _k = 0;
+    for (uint16_t i = 0; i < _n; i++)
+        if (!(_log[i].flags & SOAK_NO_LINK))
+            _sorted[_k++] = _log[i].assocMs;
+    printPercentiles(out, "   associate       ", _k);
+
+    _k = 0;
+    for (uint16_t i = 0; i < _n; i++)
+        if (!(_log[i].flags & (SOAK_NO_LINK | SOAK_NO_DNS)))
+            _sorted[_k++] = _log[i].dhcpMs;
+    printPercentiles(out, "   DHCP            ", _k);
+
+    _k = 0;
+    for (uint16_t i = 0; i < _n; i++)
+        if (_log[i].flags & SOAK_TESTED)
+            _sorted[_k++] = _log[i].testMs;
+    printPercentiles(out, "   test connect    ", _k);
+}
+
+void Soak::printLog(Print &out)
+{
+    char _buf[16];
+    uint16_t _first = _logged > SOAK_LOG_SIZE ? _logged - SOAK_LOG_SIZE : 0;
+    out.println("cycle,assoc_ms,dhcp_ms,dns,bad_dns,test,test_ms");
+    for (uint16_t _seq = _first; _seq < _logged; _seq++) {
+        const SoakRecord &_r = _log[_seq % SOAK_LOG_SIZE];
+        // _logged is held below 2 * SOAK_LOG_SIZE, so number from the end
+        out.print(_done - (_logged - _seq) + 1);
+        out.print(',');
+        out.print(_r.assocMs);
+        out.print(',');
+        out.print(_r.dhcpMs);
+        out.print(',');
+        formatIPv4(_buf, _r.dns);
+        out.print(_buf);
+        out.print(',');
+        out.print(_r.flags & SOAK_BAD_DNS ? 1 : 0);
+        out.print(',');
+        out.print(_r.flags & SOAK_NO_LINK ? "no_link" : _r.flags & SOAK_NO_DNS ? "no_dns" :
+                  !(_r.flags & SOAK_TESTED) ? "" : _r.flags & SOAK_TEST_OK ? "ok" : "failed");
+        out.print(',');
+        out.println(_r.testMs);
+    }
+}
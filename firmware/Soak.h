@@ -0,0 +1,111 @@
+/*
+ *  Soak.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Unattended soak test for the DHCP / DNS failure rate.
+ *
+ *  Runs N cycles of WiFi disconnect -> connect, or CC3000 off -> on ->
+ *  connect, advanced once per pass through loop() like NetTask.  Each cycle
+ *  is logged as a packed 12 byte record in a RAM ring of SOAK_LOG_SIZE:
+ *
+ *      associate   WiFi.connect() until WiFi.ready()
+ *      DHCP        WiFi.ready() until the CC3000 reports a DNS server
+ *      DNS         the server it reported, and whether it is 76.83.0.0
+ *      test        the test connect result and time
+ *
+ *  The report gives failure rates over all cycles and percentiles over the
+ *  cycles still in the log.
+ */
+
+#ifndef SOAK_H_
+#define SOAK_H_
+
+#include <application.h>
+
+#define SOAK_CYCLES         100     // default cycles per run
+#define SOAK_LOG_SIZE       128     // records kept
+#define SOAK_PAUSE          500     // ms between cycles
+#define SOAK_WAIT_TIMEOUT   10000   // ms for the link to drop or come up
+
+// SoakRecord flags
+#define SOAK_NO_LINK        0x01    // did not associate in time
+#define SOAK_NO_DNS         0x02    // no DNS server reported in time
+#define SOAK_BAD_DNS        0x04    // 76.83.0.0, still after FIX_DNS_BAD_WAIT
+#define SOAK_TESTED         0x08
+#define SOAK_TEST_OK        0x10
+
+struct SoakRecord {
+    uint16_t assocMs;
+    uint16_t dhcpMs;
+    uint16_t testMs;
+    uint8_t dns[4];                 // network order
+    uint8_t flags;
+    uint8_t reserved;
+} __attribute__((packed));
+
+class Soak {
+public:
+    enum Mode { WIFI, POWER };
+
+    Soak(Print &out = Serial);      // progress goes to out
+
+    // test returns true if the test connect worked, NULL for no test
+    bool start(Mode mode, uint16_t cycles = SOAK_CYCLES, bool (*test)() = NULL);
+    bool run();                     // true once, when the run completes
+    void stop();
+    bool busy() const { return _step != S_IDLE; }
+    Mode mode() const { return _mode; }
+
+    // over all cycles of the last run
+    uint16_t done() const { return _done; }
+    uint16_t noLink() const { return _noLink; }
+    uint16_t noDns() const { return _noDns; }
+    uint16_t badDns() const { return _badDns; }
+    uint16_t testFailed() const { return _testFailed; }
+    uint16_t failures() const { return _noLink + _noDns + _badDns + _testFailed; }
+
+    void report(Print &out);
+    void printLog(Print &out);      // CSV, oldest first
+
+private:
+    enum Step {
+        S_IDLE,
+        S_DOWN,             // wait for the link and the DNS setting to clear
+        S_ASSOC,            // wait for WiFi.ready()
+        S_DHCP,             // wait for a DNS server in ip_config
+        S_DNS_GOOD,         // wait while the DNS server is 76.83.0.0
+        S_PAUSE
+    };
+
+    void enter(Step step, uint32_t timeout);
+    bool expired() const { return millis() - _stepStart >= _timeout; }
+    void beginCycle();
+    void connect();
+    void endCycle(uint8_t flags);
+    static uint16_t clampMs(uint32_t ms) { return ms > 0xFFFF ? 0xFFFF : ms; }
+
+    Print &_out;
+    Mode _mode;
+    bool (*_test)();
+    Step _step;
+    uint32_t _stepStart;
+    uint32_t _timeout;
+    uint32_t _connectAt;
+    uint32_t _readyAt;
+    uint32_t _runStart;
+    uint32_t _runMs;
+    uint16_t _cycles;
+    uint16_t _done;
+    SoakRecord _cur;
+
+    // over all cycles of the run
+    uint16_t _noLink;
+    uint16_t _noDns;
+    uint16_t _badDns;
+    uint16_t _tested;
+    uint16_t _testFailed;
+};
+
+#endif /* SOAK_H_ */
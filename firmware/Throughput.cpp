@@ -0,0 +1,173 @@
+/*
+ *  Throughput.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "Throughput.h"
+#include "Trace.h"
+
+Throughput::Throughput(Print &out)
+    : _out(out), _port(80), _step(S_IDLE), _start(0), _sentAt(0), _lastByteAt(0),
+      _connectMs(0), _firstByteMs(0), _transferMs(0), _complete(false)
+{
+    strcpy(_host, "data.sparkfun.com");
+    strcpy(_path, "/");
+}
+
+bool Throughput::setTarget(const char *target)
+{
+    const char *_slash = strchr(target, '/');
+    const char *_colon = strchr(target, ':');
+    if (_slash && _colon > _slash)
+        _colon = NULL;
+    const char *_end = _colon ? _colon : _slash ? _slash : target + strlen(target);
+    uint8_t _len = _end - target;
+    if (!_len || _len > THROUGHPUT_HOST_MAX || (_slash && strlen(_slash) > THROUGHPUT_PATH_MAX))
+        return false;
+    unsigned long _p = 80;
+    if (_colon) {
+        // digits only, up to the path or the end
+        char *_digitsEnd;
+        _p = strtoul(_colon + 1, &_digitsEnd, 10);
+        bool _digits = _colon[1] >= '0' && _colon[1] <= '9';
+        if (!_digits || _digitsEnd != (_slash ? _slash : _colon + strlen(_colon)) || !_p || _p > 65535)
+            return false;
+    }
+
+    memcpy(_host, target, _len);
+    _host[_len] = 0;
+    strcpy(_path, _slash ? _slash : "/");
+    _port = _p;
+    return true;
+}
+
+bool Throughput::start(DnsCache *cache)
+{
+    if (busy())
+        return false;
+    _connectMs = _firstByteMs = _transferMs = 0;
+    _complete = false;
+    _response.begin();
+
+    _out.print("HTTP GET ");
+    _out.print(_host);
+    if (_port != 80) {
+        _out.print(':');
+        _out.print(_port);
+    }
+    _out.println(_path);
+
+    _start = millis();
+    int _ok = cache ? cache->connect(_client, _host, _port) : _client.connect(_host, _port);
+    _connectMs = millis() - _start;
+    if (!_ok) {
+        _client.stop();
+        _out.println("Error - connect failed");
+        return false;
+    }
+    _step = S_CONNECTING;
+    return true;
+}
+
+void Throughput::stop()
+{
+    if (busy())
+        done(false);
+}
+
+void Throughput::done(bool complete)
+{
+    _client.stop();
+    _complete = complete;
+    _transferMs = _lastByteAt - _sentAt;
+    _step = S_IDLE;
+    report(_out);
+}
+
+uint32_t Throughput::rate() const
+{
+    uint32_t _bytes = _response.headerBytes() + _response.bodyBytes();
+    return _transferMs ? (uint64_t) _bytes * 1000 / _transferMs : 0;
+}
+
+bool Throughput::run()
+{
+    if (!busy())
+        return false;
+    uint32_t _now = millis();
+
+    if (_step == S_CONNECTING) {
+        if (_client.connected()) {
+            _client.print("GET ");
+            _client.print(_path);
+            _client.print(" HTTP/1.1\r\nHost: ");
+            _client.print(_host);
+            _client.print("\r\nConnection: close\r\n\r\n");
+            _sentAt = _lastByteAt = millis();
+            _step = S_RECEIVING;
+        } else if (_now - _start >= THROUGHPUT_IDLE_TIMEOUT) {
+            _out.println("Error - not connected");
+            done(false);
+            return true;
+        }
+        return false;
+    }
+
+    // S_RECEIVING - everything that is in, a chunk at a time
+    uint8_t _buf[THROUGHPUT_CHUNK];
+    int _n;
+    while (_client.available() && (_n = _client.read(_buf, sizeof(_buf))) > 0) {
+        _lastByteAt = millis();
+        if (!_response.headerBytes()) {
+            _firstByteMs = _lastByteAt - _sentAt;
+            trace(TR_FIRST_BYTE, _n);
+        }
+        _response.feed(_buf, _n);
+    }
+
+    if (_response.complete())
+        done(true);
+    else if (!_client.connected()) {
+        _response.close();                  // without a length the close ends the body
+        done(_response.complete());
+    } else if (millis() - _lastByteAt >= THROUGHPUT_IDLE_TIMEOUT) {
+        _out.println("Error - response stalled");
+        done(false);
+    } else
+        return false;
+    return true;
+}
+
+void Throughput::report(Print &out)
+{
+    uint32_t _body = _response.bodyBytes();
+    int32_t _length = _response.length();
+    out.print("   status      ");
+    out.println(_response.status());
+    out.print("   connect     ");
+    out.print(_connectMs);
+    out.println(" ms");
+    out.print("   first byte  ");
+    out.print(_firstByteMs);
+    out.println(" ms");
+    out.print("   received    ");
+    out.print(_response.headerBytes() + _body);
+    out.print(" bytes, ");
+    out.print(_body);
+    out.print(" body");
+    if (_length >= 0 && _body != (uint32_t) _length) {
+        out.print(" of ");
+        out.print(_length);
+    }
+    out.print(" in ");
+    out.print(_transferMs);
+    out.println(" ms");
+    uint32_t _rate = rate();
+    out.print("   throughput  ");
+    out.print(_rate / 1024);
+    out.print('.');
+    out.print((_rate % 1024) * 10 / 1024);
+    out.println(" KB/s");
+}
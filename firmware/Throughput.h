@@ -0,0 +1,66 @@
+/*
+ *  Throughput.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  HTTP/1.1 GET throughput test.
+ *
+ *  Sends a real request for host, path and port and drains the response
+ *  with bulk read(buf, len) into a THROUGHPUT_CHUNK buffer on the stack,
+ *  once per pass through loop(), through an HttpResponse.  Reports connect
+ *  time, time to first byte, bytes and KB/s over the transfer.
+ */
+
+#ifndef THROUGHPUT_H_
+#define THROUGHPUT_H_
+
+#include <application.h>
+#include "DnsCache.h"
+#include "HttpResponse.h"
+
+#define THROUGHPUT_CHUNK        512     // bytes per read()
+#define THROUGHPUT_IDLE_TIMEOUT 10000   // ms without a byte before giving up
+#define THROUGHPUT_HOST_MAX     48
+#define THROUGHPUT_PATH_MAX     48
+
+class Throughput {
+public:
+    Throughput(Print &out = Serial);
+
+    // "host", "host/path" or "host:port/path", the path defaults to /
+    bool setTarget(const char *target);
+    bool start(DnsCache *cache = NULL);
+    bool run();                         // true once, when the response is in or it failed
+    void stop();
+    bool busy() const { return _step != S_IDLE; }
+
+    bool succeeded() const { return _response.status() / 100 == 2 && _complete; }
+    uint16_t status() const { return _response.status(); }  // HTTP status, 0 if none
+    uint32_t bodyBytes() const { return _response.bodyBytes(); }
+    uint32_t firstByteMs() const { return _firstByteMs; }
+    uint32_t rate() const;                              // bytes per second
+    void report(Print &out);
+
+private:
+    enum Step { S_IDLE, S_CONNECTING, S_RECEIVING };
+
+    void done(bool complete);
+
+    Print &_out;
+    TCPClient _client;
+    char _host[THROUGHPUT_HOST_MAX + 1];
+    char _path[THROUGHPUT_PATH_MAX + 1];
+    uint16_t _port;
+    Step _step;
+    uint32_t _start;
+    uint32_t _sentAt;
+    uint32_t _lastByteAt;
+    uint32_t _connectMs;
+    uint32_t _firstByteMs;
+    uint32_t _transferMs;
+    bool _complete;
+    HttpResponse _response;
+};
+
+#endif /* THROUGHPUT_H_ */
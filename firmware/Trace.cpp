@@ -0,0 +1,256 @@
+/*
+ *  Trace.cpp
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "Trace.h"
+#include "NetState.h"
+
+static const char *_eventName[TR_COUNT] = {
+    "boot", "cc3000_on", "cc3000_off", "wifi_connect", "wifi_disconnect",
+    "wifi_up", "wifi_down", "dhcp_lease", "dhcp_reset", "dns_valid", "dns_bad",
+    "dns_clear", "cloud_connect", "cloud_disconnect", "cloud_up", "cloud_down",
+    "fix_dns", "op_done", "tcp_connect", "tcp_connected", "tcp_failed", "first_byte"
+};
+
+static TraceRecord _ring[TRACE_SIZE];
+static uint32_t _count;                 // records since boot, the next seq
+
+// last state seen by traceWatch()
+static bool _watching;
+static bool _ready;
+static bool _leased;
+static uint8_t _dns;                    // TR_DNS_VALID, TR_DNS_BAD or TR_DNS_CLEAR
+static bool _cloud;
+
+void trace(TraceEvent event, uint16_t detail)
+{
+    TraceRecord &_r = _ring[_count % TRACE_SIZE];
+    _r.us = micros();
+    _r.event = event;
+    _r.reserved = 0;
+    _r.detail = detail;
+    _count++;
+}
+
+uint32_t traceCount()
+{
+    return _count;
+}
+
+void traceWatch()
+{
+    static uint32_t _seen;
+    if (!netStateChanged(_seen) && _watching)
+        return;                         // nothing has changed since the last look
+
+    NetState _s;
+    netStateRead(_s);
+    bool _nowReady = _s.ready;
+    bool _nowLeased = _s.ip[0] != 0 || _s.ip[3] != 0;
+    uint8_t _nowDns = _s.dnsBad ? TR_DNS_BAD : _s.dnsSet ? TR_DNS_VALID : TR_DNS_CLEAR;
+    bool _nowCloud = _s.ready && _s.cloud;
+
+    if (!_watching) {
+        // the state at boot is not a transition
+        _watching = true;
+        trace(TR_BOOT);
+    } else {
+        if (_nowReady != _ready)
+            trace(_nowReady ? TR_WIFI_UP : TR_WIFI_DOWN);
+        if (_nowLeased && !_leased)
+            trace(TR_DHCP_LEASE, _s.ip[3]);
+        if (_nowDns != _dns)
+            trace((TraceEvent) _nowDns, _nowDns == TR_DNS_VALID ? _s.dns[3] : 0);
+        if (_nowCloud != _cloud)
+            trace(_nowCloud ? TR_CLOUD_UP : TR_CLOUD_DOWN);
+    }
+    _ready = _nowReady;
+    _leased = _nowLeased;
+    _dns = _nowDns;
+    _cloud = _nowCloud;
+}
+
+static uint32_t firstSeq()
+{
+    return _count > TRACE_SIZE ? _count - TRACE_SIZE : 0;
+}
+
+void traceDumpCsv(Print &out)
+{
+    out.println("seq,us,event,detail");
+    for (uint32_t _seq = firstSeq(); _seq < _count; _seq++) {
+        const TraceRecord &_r = _ring[_seq % TRACE_SIZE];
+        out.print(_seq);
+        out.print(',');
+        out.print(_r.us);
+        out.print(',');
+        out.print(_eventName[_r.event]);
+        out.print(',');
+        out.println(_r.detail);
+    }
+}
+
+void traceDumpJson(Print &out)
+{
+    for (uint32_t _seq = firstSeq(); _seq < _count; _seq++) {
+        const TraceRecord &_r = _ring[_seq % TRACE_SIZE];
+        out.print("{\"seq\":");
+        out.print(_seq);
+        out.print(",\"us\":");
+        out.print(_r.us);
+        out.print(",\"event\":\"");
+        out.print(_eventName[_r.event]);
+        out.print("\",\"detail\":");
+        out.print(_r.detail);
+        out.println("}");
+    }
+}
+
+/*
+ *  Binary recording
+ */
+#define REC_MAX     60      // varint, kind, param, 5 addresses, SSID length and 32 bytes
+
+static uint8_t _rec[TRACE_REC_SIZE];
+static uint16_t _recHead;               // the oldest record
+static uint16_t _recLen;                // bytes in use
+static uint32_t _recHeadUs;             // micros() of the oldest record
+static uint32_t _recLastUs;             // micros() of the newest record
+
+static uint8_t recByte(uint16_t offset)
+{
+    return _rec[(_recHead + offset) % TRACE_REC_SIZE];
+}
+
+// a varint at offset, returns its length
+static uint8_t recVarint(uint16_t offset, uint32_t &value)
+{
+    uint8_t _n = 0;
+    uint8_t _b;
+    value = 0;
+    do {
+        _b = recByte(offset + _n);
+        value |= (uint32_t) (_b & 0x7F) << (7 * _n);
+        _n++;
+    } while (_b & 0x80);
+    return _n;
+}
+
+static uint8_t recLength(uint16_t offset)
+{
+    uint32_t _delta;
+    uint8_t _n = recVarint(offset, _delta);
+    uint8_t _kind = recByte(offset + _n);
+    uint8_t _param = recByte(offset + _n + 1);
+    _n += 2;
+    if (_kind == REC_CONFIG) {
+        for (uint8_t _bit = REC_IP; _bit < REC_SSID; _bit <<= 1)
+            if (_param & _bit)
+                _n += 4;
+        if (_param & REC_SSID)
+            _n += 1 + recByte(offset + _n);
+    }
+    return _n;
+}
+
+static void recDropOldest()
+{
+    uint8_t _n = recLength(0);
+    _recHead = (_recHead + _n) % TRACE_REC_SIZE;
+    _recLen -= _n;
+    if (_recLen) {
+        uint32_t _delta;
+        recVarint(0, _delta);
+        _recHeadUs += _delta;
+    }
+}
+
+static void recAppend(uint32_t us, const uint8_t *data, uint8_t len)
+{
+    while (_recLen + len > TRACE_REC_SIZE)
+        recDropOldest();
+    if (!_recLen)
+        _recHeadUs = us;
+    for (uint8_t i = 0; i < len; i++)
+        _rec[(_recHead + _recLen + i) % TRACE_REC_SIZE] = data[i];
+    _recLen += len;
+    _recLastUs = us;
+}
+
+static uint8_t putVarint(uint8_t *p, uint32_t value)
+{
+    uint8_t _n = 0;
+    while (value >= 0x80) {
+        p[_n++] = value | 0x80;
+        value >>= 7;
+    }
+    p[_n++] = value;
+    return _n;
+}
+
+static void recWrite(TraceRecKind kind, uint8_t param, const uint8_t *payload, uint8_t len)
+{
+    uint8_t _buf[REC_MAX];
+    uint32_t _us = micros();
+    uint8_t _n = putVarint(_buf, _recLen ? _us - _recLastUs : 0);
+    _buf[_n++] = kind;
+    _buf[_n++] = param;
+    memcpy(_buf + _n, payload, len);
+    recAppend(_us, _buf, _n + len);
+}
+
+void traceRecord(TraceRecKind kind, uint8_t param)
+{
+    recWrite(kind, param, NULL, 0);
+}
+
+void traceRecordConfig(const tNetappIpconfigRetArgs &was, const tNetappIpconfigRetArgs &now)
+{
+    const unsigned char *_was[] = { was.aucIP, was.aucSubnetMask, was.aucDefaultGateway, was.aucDHCPServer, was.aucDNSServer };
+    const unsigned char *_now[] = { now.aucIP, now.aucSubnetMask, now.aucDefaultGateway, now.aucDHCPServer, now.aucDNSServer };
+    uint8_t _payload[REC_MAX];
+    uint8_t _n = 0;
+    uint8_t _fields = 0;
+    for (uint8_t i = 0; i < 5; i++)
+        if (memcmp(_was[i], _now[i], 4)) {
+            _fields |= 1 << i;
+            memcpy(_payload + _n, _now[i], 4);
+            _n += 4;
+        }
+    if (memcmp(was.uaSSID, now.uaSSID, sizeof(now.uaSSID))) {
+        uint8_t _len = 0;
+        while (_len < sizeof(now.uaSSID) && now.uaSSID[_len])
+            _len++;
+        _fields |= REC_SSID;
+        _payload[_n++] = _len;
+        memcpy(_payload + _n, now.uaSSID, _len);
+        _n += _len;
+    }
+    if (_fields)
+        recWrite(REC_CONFIG, _fields, _payload, _n);
+}
+
+uint16_t traceRecordBytes()
+{
+    return _recLen;
+}
+
+void traceDumpBinary(Print &out)
+{
+    static const char _hex[] = "0123456789abcdef";
+    out.print("#dtr1 ");
+    out.print(_recHeadUs);
+    out.print(' ');
+    out.println(_recLen);
+    for (uint16_t i = 0; i < _recLen; i++) {
+        uint8_t _b = recByte(i);
+        out.print(_hex[_b >> 4]);
+        out.print(_hex[_b & 0x0F]);
+        if (i % 32 == 31 || i + 1 == _recLen)
+            out.println();
+    }
+    out.println("#end");
+}
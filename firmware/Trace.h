@@ -0,0 +1,95 @@
+/*
+ *  Trace.h
+ *
+ *  Copyright (c) 2014, 2015 Piette Technologies, LTD
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ *
+ *  Network transition trace.
+ *
+ *  Each record is a micros() timestamp, an event and a 16 bit detail, kept
+ *  in a fixed ring of TRACE_SIZE records - the oldest are overwritten.
+ *  Requests (CC3000 on, WiFi connect, TCP connect, ...) are traced where the
+ *  code makes them; state changes the CC3000 makes on its own (link up,
+ *  lease, DNS valid or bad, cloud up) are picked up by traceWatch() once per
+ *  pass through loop().
+ *
+ *  The ring dumps as CSV or as JSON lines; seq numbers every record since
+ *  boot, so repeated dumps can be merged without duplicates.
+ *
+ *  Separately, what the CC3000 and the cloud did - the System network and
+ *  cloud events and every ip_config change - is recorded for replay by the
+ *  host build.  Each record is the micros() since the one
+ *  before as a varint, a kind byte and its payload; an ip_config change
+ *  carries only the fields that changed, as ip_config holds them.  The
+ *  records share a TRACE_REC_SIZE byte ring, the oldest are dropped, and
+ *  the ring dumps as hex lines between "#dtr1 <us of the first> <bytes>"
+ *  and "#end" that can be cut from a console log.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <application.h>
+
+#define TRACE_SIZE  64      // records, 8 bytes each
+#define TRACE_REC_SIZE  512 // bytes of binary recording, 8 to 60 bytes a record
+
+enum TraceEvent {
+    TR_BOOT,
+    TR_CC3000_ON,       // requested
+    TR_CC3000_OFF,      // requested
+    TR_WIFI_CONNECT,    // requested
+    TR_WIFI_DISCONNECT, // requested
+    TR_WIFI_UP,         // WiFi.ready()
+    TR_WIFI_DOWN,
+    TR_DHCP_LEASE,      // local IP assigned, detail = last octet
+    TR_DHCP_RESET,      // netapp_dhcp written, detail 1 = DHCP, 0 = static
+    TR_DNS_VALID,       // detail = last octet of the DNS server
+    TR_DNS_BAD,         // 76.83.0.0
+    TR_DNS_CLEAR,
+    TR_CLOUD_CONNECT,   // requested
+    TR_CLOUD_DISCONNECT,// requested
+    TR_CLOUD_UP,
+    TR_CLOUD_DOWN,
+    TR_FIX_DNS,         // requested
+    TR_OP_DONE,         // detail 1 = succeeded
+    TR_TCP_CONNECT,     // detail = port
+    TR_TCP_CONNECTED,
+    TR_TCP_FAILED,
+    TR_FIRST_BYTE,      // detail = bytes available
+    TR_COUNT
+};
+
+struct TraceRecord {
+    uint32_t us;
+    uint8_t event;
+    uint8_t reserved;
+    uint16_t detail;
+};
+
+enum TraceRecKind {
+    REC_NETWORK = 1,    // param = network_status_...
+    REC_CLOUD,          // param = cloud_status_...
+    REC_CONFIG          // param = REC_IP | ..., the changed fields follow
+};
+
+// REC_CONFIG fields, in this order, 4 bytes each but the SSID
+#define REC_IP          0x01
+#define REC_MASK        0x02
+#define REC_GATEWAY     0x04
+#define REC_DHCP_SERVER 0x08
+#define REC_DNS         0x10
+#define REC_SSID        0x20    // length byte, then the bytes
+
+void trace(TraceEvent event, uint16_t detail = 0);
+void traceWatch();                      // record link / lease / DNS / cloud changes
+void traceDumpCsv(Print &out);
+void traceDumpJson(Print &out);
+uint32_t traceCount();                  // records since boot
+
+void traceRecord(TraceRecKind kind, uint8_t param);
+void traceRecordConfig(const tNetappIpconfigRetArgs &was, const tNetappIpconfigRetArgs &now);
+void traceDumpBinary(Print &out);
+uint16_t traceRecordBytes();            // in the ring now
+
+#endif /* TRACE_H_ */
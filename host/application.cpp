@@ -0,0 +1,496 @@
+/*
+ *  application.cpp  (host build)
+ *
+ *  Wiring API and CC3000 host driver entry points, routed to the simulator
+ *  bound to the calling thread.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "application.h"
+#include "cc3000_sim.h"
+
+static System_Mode_TypeDef _systemMode = AUTOMATIC;
+
+SystemClass::SystemClass(System_Mode_TypeDef mode)
+{
+    _systemMode = mode;
+}
+
+System_Mode_TypeDef SystemClass::mode()
+{
+    return _systemMode;
+}
+
+bool SystemClass::on(system_event_t events, system_event_handler_t handler)
+{
+    return sim::current().subscribe(events, handler);
+}
+
+SystemClass System;
+
+/*
+ *  Timing
+ */
+system_tick_t millis(void)
+{
+    sim::CC3000 &cc = sim::current();
+    cc.advance(1);
+    return (system_tick_t) (cc.now() / 1000);
+}
+
+unsigned long micros(void)
+{
+    sim::CC3000 &cc = sim::current();
+    cc.advance(1);
+    return (unsigned long) (uint32_t) cc.now();
+}
+
+void delay(unsigned long ms)
+{
+    sim::current().advance((uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    sim::current().advance(us);
+}
+
+/*
+ *  Random numbers
+ */
+void randomSeed(unsigned int seed)
+{
+    sim::current().rng().seed(seed);
+}
+
+long random(long max)
+{
+    return max > 0 ? random(0, max) : 0;
+}
+
+long random(long min, long max)
+{
+    if (min >= max)
+        return min;
+    return min + (long) (sim::current().rng()() % (uint64_t) (max - min));
+}
+
+/*
+ *  Print
+ */
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+        n += write(*buffer++);
+    return n;
+}
+
+size_t Print::printNumber(unsigned long n, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    if (base < 2)
+        base = 10;
+    *str = '\0';
+    do {
+        unsigned long m = n;
+        n /= base;
+        char c = m - base * n;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
+
+size_t Print::print(const char *str)            { return write(str); }
+size_t Print::print(char c)                     { return write((uint8_t) c); }
+size_t Print::print(unsigned char n, int base)  { return print((unsigned long) n, base); }
+size_t Print::print(int n, int base)            { return print((long) n, base); }
+size_t Print::print(unsigned int n, int base)   { return print((unsigned long) n, base); }
+
+size_t Print::print(long n, int base)
+{
+    if (base == DEC && n < 0)
+        return write('-') + printNumber(-(unsigned long) n, DEC);
+    return printNumber((unsigned long) n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+size_t Print::println(void)                             { return write("\r\n"); }
+size_t Print::println(const char *str)                  { return print(str) + println(); }
+size_t Print::println(char c)                           { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base)        { return print(n, base) + println(); }
+size_t Print::println(int n, int base)                  { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base)         { return print(n, base) + println(); }
+size_t Print::println(long n, int base)                 { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base)        { return print(n, base) + println(); }
+size_t Print::println(double n, int digits)             { return print(n, digits) + println(); }
+
+/*
+ *  Serial
+ */
+USBSerial Serial;
+
+void USBSerial::begin(long baud)    { sim::current().serialBegin(baud); }
+void USBSerial::end()               { }
+int USBSerial::available()          { return sim::current().serialAvailable(); }
+int USBSerial::read()               { return sim::current().serialRead(); }
+int USBSerial::peek()               { return sim::current().serialRead(true); }
+void USBSerial::flush()             { fflush(stdout); }
+int USBSerial::availableForWrite()  { return sim::current().serialAvailableForWrite(); }
+
+size_t USBSerial::write(uint8_t c)
+{
+    return sim::current().serialWrite(&c, 1);
+}
+
+size_t USBSerial::write(const uint8_t *buffer, size_t size)
+{
+    return sim::current().serialWrite(buffer, size);
+}
+
+/*
+ *  IPAddress
+ */
+IPAddress::IPAddress()
+{
+    memset(_address, 0, sizeof(_address));
+}
+
+IPAddress::IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+    _address[0] = b0;
+    _address[1] = b1;
+    _address[2] = b2;
+    _address[3] = b3;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+    memcpy(_address, &address, sizeof(_address));
+}
+
+IPAddress::IPAddress(const uint8_t *address)
+{
+    memcpy(_address, address, sizeof(_address));
+}
+
+IPAddress::operator uint32_t() const
+{
+    uint32_t address;
+    memcpy(&address, _address, sizeof(address));
+    return address;
+}
+
+/*
+ *  WiFi
+ */
+WiFiClass WiFi;
+
+void WiFiClass::on(void)            { sim::current().powerOn(); }
+void WiFiClass::off(void)           { sim::current().powerOff(); }
+void WiFiClass::connect(void)       { sim::current().connect(); }
+void WiFiClass::disconnect(void)    { sim::current().disconnect(); }
+bool WiFiClass::connecting(void)    { return sim::current().connecting(); }
+bool WiFiClass::ready(void)         { return sim::current().ready(); }
+void WiFiClass::listen(void)        { }
+bool WiFiClass::listening(void)     { return sim::current().listening(); }
+bool WiFiClass::hasCredentials(void) { return sim::current().hasCredentials(); }
+const char *WiFiClass::SSID(void)   { return sim::current().ssid(); }
+int8_t WiFiClass::RSSI(void)        { return sim::current().rssi(); }
+
+void WiFiClass::setCredentials(const char *ssid, const char *password, unsigned long security)
+{
+    sim::CC3000 &cc = sim::current();
+    cc.advance(cc.draw(cc.config().nvmem_write_ms) * 1000ULL);
+    cc.setCredentials(true);
+}
+
+bool WiFiClass::clearCredentials(void)
+{
+    sim::current().setCredentials(false);
+    return true;
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+    // same byte order as ip_config.uaMacAddr, i.e. reversed
+    memcpy(mac, sim::current().ipConfig.uaMacAddr, 6);
+    return mac;
+}
+
+static IPAddress fromConfig(const unsigned char *addr)
+{
+    return IPAddress(addr[3], addr[2], addr[1], addr[0]);
+}
+
+IPAddress WiFiClass::localIP(void)      { return fromConfig(sim::current().ipConfig.aucIP); }
+IPAddress WiFiClass::subnetMask(void)   { return fromConfig(sim::current().ipConfig.aucSubnetMask); }
+IPAddress WiFiClass::gatewayIP(void)    { return fromConfig(sim::current().ipConfig.aucDefaultGateway); }
+
+IPAddress WiFiClass::resolve(const char *name)
+{
+    uint8_t ip[4];
+    if (!sim::current().resolve(name, ip))
+        return IPAddress();
+    return IPAddress(ip);
+}
+
+/*
+ *  Cloud
+ */
+CloudClass Particle;
+
+void CloudClass::connect(void)      { sim::current().cloudConnect(); }
+void CloudClass::disconnect(void)   { sim::current().cloudDisconnect(); }
+bool CloudClass::connected(void)    { return sim::current().cloudConnected(); }
+void CloudClass::process(void)      { sim::current().poll(); }
+
+/*
+ *  TCPClient
+ */
+TCPClient::TCPClient() : _sock(-1)
+{
+}
+
+int TCPClient::connect(IPAddress ip, uint16_t port)
+{
+    sim::CC3000 &cc = sim::current();
+    stop();
+    _sock = cc.socketOpen();
+    if (_sock < 0)
+        return 0;
+    if (!cc.socketConnect(_sock, ip.raw_address(), port)) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+int TCPClient::connect(const char *host, uint16_t port)
+{
+    uint8_t ip[4];
+    if (!sim::current().resolve(host, ip))
+        return 0;
+    return connect(IPAddress(ip), port);
+}
+
+size_t TCPClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t TCPClient::write(const uint8_t *buffer, size_t size)
+{
+    if (_sock < 0)
+        return -1;
+    return sim::current().socketWrite(_sock, buffer, size);
+}
+
+int TCPClient::available()
+{
+    return _sock < 0 ? 0 : sim::current().socketAvailable(_sock);
+}
+
+int TCPClient::read()
+{
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int TCPClient::read(uint8_t *buffer, size_t size)
+{
+    if (_sock < 0)
+        return -1;
+    int n = sim::current().socketRead(_sock, buffer, size);
+    return n > 0 ? n : -1;
+}
+
+int TCPClient::peek()
+{
+    uint8_t b;
+    if (_sock < 0 || sim::current().socketRead(_sock, &b, 1, true) != 1)
+        return -1;
+    return b;
+}
+
+void TCPClient::flush()
+{
+    while (available())
+        read();
+}
+
+void TCPClient::stop()
+{
+    if (_sock >= 0)
+        sim::current().socketClose(_sock);
+    _sock = -1;
+}
+
+uint8_t TCPClient::connected()
+{
+    if (_sock < 0)
+        return 0;
+    return sim::current().socketConnected(_sock) || available();
+}
+
+/*
+ *  UDP
+ */
+UDP::UDP() : _sock(-1), _remotePort(0), _offset(0), _total(0)
+{
+}
+
+uint8_t UDP::begin(uint16_t port)
+{
+    stop();
+    _sock = sim::current().socketOpen();
+    return _sock >= 0;
+}
+
+void UDP::stop()
+{
+    if (_sock >= 0)
+        sim::current().socketClose(_sock);
+    _sock = -1;
+    _offset = _total = 0;
+}
+
+int UDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    if (_sock < 0)
+        return 0;
+    _remoteIP = ip;
+    _remotePort = port;
+    _offset = _total = 0;
+    return 1;
+}
+
+int UDP::endPacket()
+{
+    if (_sock < 0)
+        return 0;
+    int n = sim::current().udpSend(_sock, _remoteIP.raw_address(), _remotePort, _buffer, _offset);
+    _offset = _total = 0;
+    return n;
+}
+
+size_t UDP::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t UDP::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = size < (size_t) (UDP_BUFFER_SIZE - _offset) ? size : UDP_BUFFER_SIZE - _offset;
+    memcpy(_buffer + _offset, buffer, n);
+    _offset += n;
+    return n;
+}
+
+int UDP::parsePacket()
+{
+    if (_sock < 0)
+        return 0;
+    uint8_t ip[4];
+    int n = sim::current().udpReceive(_sock, _buffer, sizeof(_buffer), ip, &_remotePort);
+    _offset = 0;
+    _total = n > 0 ? n : 0;
+    if (n > 0)
+        _remoteIP = IPAddress(ip);
+    return _total;
+}
+
+int UDP::available()
+{
+    return _total - _offset;
+}
+
+int UDP::read()
+{
+    return _offset < _total ? _buffer[_offset++] : -1;
+}
+
+int UDP::read(unsigned char *buffer, size_t len)
+{
+    int n = available();
+    if (n <= 0)
+        return -1;
+    if ((size_t) n > len)
+        n = len;
+    memcpy(buffer, _buffer + _offset, n);
+    _offset += n;
+    return n;
+}
+
+int UDP::peek()
+{
+    return _offset < _total ? _buffer[_offset] : -1;
+}
+
+void UDP::flush()
+{
+    _offset = _total = 0;
+}
+
+/*
+ *  EEPROM
+ */
+EEPROMClass EEPROM;
+
+uint8_t EEPROMClass::read(int address)
+{
+    return sim::current().eepromRead(address);
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    sim::current().eepromWrite(address, value);
+}
+
+/*
+ *  CC3000 host driver
+ */
+tNetappIpconfigRetArgs &sim_ip_config(void)
+{
+    return sim::current().ipConfig;
+}
+
+long netapp_dhcp(uint32_t *aucIP, uint32_t *aucSubnetMask, uint32_t *aucDefaultGateway, uint32_t *aucDNSServer)
+{
+    // the driver streams the four words as raw bytes
+    return sim::current().setDhcp((const uint8_t *) aucIP, (const uint8_t *) aucSubnetMask,
+        (const uint8_t *) aucDefaultGateway, (const uint8_t *) aucDNSServer);
+}
+
+void wlan_start(unsigned short usPatchesAvailableAtHost)
+{
+    sim::current().wlanStart();
+}
+
+void wlan_stop(void)
+{
+    sim::current().wlanStop();
+}
+
+unsigned char nvmem_get_mac_address(unsigned char *mac)
+{
+    sim::CC3000 &cc = sim::current();
+    if (!cc.powered())
+        return 1;
+    cc.macAddress(mac);
+    return 0;
+}
@@ -0,0 +1,321 @@
+/*
+ *  application.h  (host build)
+ *
+ *  Stand-in for the Spark/Particle firmware API so that firmware/DNSTest.cpp
+ *  builds and runs unmodified as a Linux process.  Only the parts of the
+ *  Wiring API and the TI CC3000 host driver that DNSTest uses are provided.
+ *
+ *  Everything here is backed by the simulated CC3000 in cc3000_sim.h, which
+ *  also owns the simulated clock - millis(), micros() and delay() run on
+ *  simulated time, not wall-clock time.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#ifndef APPLICATION_H_
+#define APPLICATION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef uint32_t system_tick_t;
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/*
+ *  System mode
+ */
+typedef enum {
+    AUTOMATIC = 0,
+    SEMI_AUTOMATIC = 1,
+    MANUAL = 2
+} System_Mode_TypeDef;
+
+/*
+ *  System events - the subset of System.on() the network state snapshot
+ *  uses.  The handler runs from inside the system code (on the Core, the
+ *  CC3000 event handling), never concurrently with another handler.
+ */
+typedef uint64_t system_event_t;
+
+enum SystemEvents {
+    network_status = 1 << 5,
+    cloud_status = 1 << 6
+};
+
+enum SystemEventsParam {
+    network_status_powering_off = 2,
+    network_status_off = 3,
+    network_status_powering_on = 4,
+    network_status_on = 5,
+    network_status_connecting = 8,
+    network_status_connected = 9,
+    network_status_disconnecting = 12,
+    network_status_disconnected = 13,
+
+    cloud_status_disconnected = 0,
+    cloud_status_connecting = 1,
+    cloud_status_connected = 8,
+    cloud_status_disconnecting = 9
+};
+
+typedef void (*system_event_handler_t)(system_event_t event, int param);
+
+class SystemClass {
+public:
+    SystemClass() {}
+    SystemClass(System_Mode_TypeDef mode);
+    static System_Mode_TypeDef mode();
+    static bool on(system_event_t events, system_event_handler_t handler);
+};
+
+extern SystemClass System;
+
+#define SYSTEM_MODE(mode)  SystemClass SystemMode(mode);
+
+/*
+ *  Timing - all of these run on the simulator clock
+ */
+system_tick_t millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/*
+ *  Random numbers - from the simulator's seeded generator
+ */
+void randomSeed(unsigned int seed);
+long random(long max);
+long random(long min, long max);
+
+/*
+ *  Print / Stream
+ */
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return str ? write((const uint8_t *) str, strlen(str)) : 0; }
+
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println(void);
+    size_t println(const char *str);
+    size_t println(char c);
+    size_t println(unsigned char n, int base = DEC);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+
+private:
+    size_t printNumber(unsigned long n, int base);
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+};
+
+class USBSerial : public Stream {
+public:
+    void begin(long baud);
+    void end();
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int availableForWrite();
+    operator bool() { return true; }
+};
+
+extern USBSerial Serial;
+
+/*
+ *  IPAddress - byte 0 is the first octet, as on the device
+ */
+class IPAddress {
+public:
+    IPAddress();
+    IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3);
+    IPAddress(uint32_t address);
+    IPAddress(const uint8_t *address);
+
+    operator uint32_t() const;
+    bool operator==(const IPAddress &addr) const { return !memcmp(_address, addr._address, 4); }
+    uint8_t operator[](int index) const { return _address[index]; }
+    uint8_t &operator[](int index) { return _address[index]; }
+    const uint8_t *raw_address() const { return _address; }
+
+private:
+    uint8_t _address[4];
+};
+
+/*
+ *  WiFi
+ */
+#define WPA2 3
+
+class WiFiClass {
+public:
+    void on(void);
+    void off(void);
+    void connect(void);
+    void disconnect(void);
+    bool connecting(void);
+    bool ready(void);
+    void listen(void);
+    bool listening(void);
+    void setCredentials(const char *ssid, const char *password, unsigned long security = WPA2);
+    bool clearCredentials(void);
+    bool hasCredentials(void);
+    uint8_t *macAddress(uint8_t *mac);
+    IPAddress localIP(void);
+    IPAddress subnetMask(void);
+    IPAddress gatewayIP(void);
+    const char *SSID(void);
+    int8_t RSSI(void);
+    IPAddress resolve(const char *name);
+};
+
+extern WiFiClass WiFi;
+
+/*
+ *  Cloud
+ */
+class CloudClass {
+public:
+    static void connect(void);
+    static void disconnect(void);
+    static bool connected(void);
+    static void process(void);
+};
+
+extern CloudClass Particle;
+#define Spark Particle
+
+/*
+ *  TCPClient
+ */
+class TCPClient : public Stream {
+public:
+    TCPClient();
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int available();
+    int read();
+    int read(uint8_t *buffer, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool() { return connected() != 0; }
+
+private:
+    int _sock;
+};
+
+/*
+ *  UDP - one datagram per parsePacket()
+ */
+#define UDP_BUFFER_SIZE 512
+
+class UDP : public Stream {
+public:
+    UDP();
+
+    uint8_t begin(uint16_t port);
+    void stop();
+    int beginPacket(IPAddress ip, uint16_t port);
+    int endPacket();
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int parsePacket();
+    int available();
+    int read();
+    int read(unsigned char *buffer, size_t len);
+    int peek();
+    void flush();
+    IPAddress remoteIP() { return _remoteIP; }
+    uint16_t remotePort() { return _remotePort; }
+
+private:
+    int _sock;
+    IPAddress _remoteIP;
+    uint16_t _remotePort;
+    uint8_t _buffer[UDP_BUFFER_SIZE];
+    uint16_t _offset;
+    uint16_t _total;
+};
+
+/*
+ *  EEPROM - emulated in flash on the Core, 100 bytes
+ */
+#define EEPROM_SIZE 100
+
+class EEPROMClass {
+public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    int length() { return EEPROM_SIZE; }
+};
+
+extern EEPROMClass EEPROM;
+
+/*
+ *  TI CC3000 host driver
+ */
+typedef struct _netapp_ipconfig_ret_args_t {
+    unsigned char aucIP[4];
+    unsigned char aucSubnetMask[4];
+    unsigned char aucDefaultGateway[4];
+    unsigned char aucDHCPServer[4];
+    unsigned char aucDNSServer[4];
+    unsigned char uaMacAddr[6];
+    unsigned char uaSSID[32];
+} tNetappIpconfigRetArgs;
+
+// On the device ip_config is a global refreshed by the CC3000 event handler;
+// here it belongs to the simulator the calling thread is bound to.
+tNetappIpconfigRetArgs &sim_ip_config(void);
+#define ip_config (sim_ip_config())
+
+long netapp_dhcp(uint32_t *aucIP, uint32_t *aucSubnetMask, uint32_t *aucDefaultGateway, uint32_t *aucDNSServer);
+void wlan_start(unsigned short usPatchesAvailableAtHost);
+void wlan_stop(void);
+unsigned char nvmem_get_mac_address(unsigned char *mac);
+
+/*
+ *  Provided by the application
+ */
+void setup(void);
+void loop(void);
+
+#endif /* APPLICATION_H_ */
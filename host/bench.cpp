@@ -0,0 +1,419 @@
+/*
+ *  bench.cpp  (host build)
+ *
+ *  Times the connect, recovery and console paths of the whole DNSTest
+ *  firmware against the simulated CC3000 and compares the times with a
+ *  stored baseline, so a change that slows them down fails before it is
+ *  flashed.
+ *
+ *  Every benchmark is a scripted console session that runs setup() and
+ *  loop() from power up until the path it times has finished, once per
+ *  seed.  The firmware keeps its state in globals, so each session runs in
+ *  a forked child with a fresh image and sends back its one time.  The
+ *  times are simulated - the firmware's own delays, polling and serial
+ *  output at the console baud - so a run is repeatable to the microsecond
+ *  and a baseline from one machine holds on another.
+ *
+ *  usage: dnstest-bench [-n seeds] [-o out.json] [-b baseline.json] [-t percent] [setting=value ...]
+ *
+ *      -n seeds        sessions per benchmark, seeds 1..n, default 10
+ *      -o file         write the results as JSON, default stdout
+ *      -b file         compare with a baseline written by -o
+ *      -t percent      a median or p90 more than this much over the
+ *                      baseline, and at least BENCH_SLACK_MS, fails the
+ *                      run, default 10
+ *      setting=value   any script setting, applied to every session
+ *
+ *  Exits 1 when a benchmark regressed or a session did not finish, or when
+ *  loop() blocked on console output at all - SERIAL_OUT_SIZE has to hold
+ *  the largest render.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "cc3000_sim.h"
+#include "../firmware/NetState.h"
+
+#include <algorithm>
+#include <functional>
+#include <math.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_RUN_MS    300000  // a session that has not finished by then failed
+#define BENCH_SLACK_MS  1.0     // differences below this are never a regression
+
+/*
+ *  The sessions
+ */
+struct Session {
+    sim::CC3000 *cc3000;
+    std::string out;            // serial output so far
+    size_t mark;                // where the output of interest starts
+    uint64_t startUs;
+
+    // batch "ok <cmd> <n>ms" line after mark, true with its time
+    bool batchTime(const char *cmd, double &ms) const;
+    uint64_t now() const { return cc3000->now(); }
+};
+
+bool Session::batchTime(const char *cmd, double &ms) const
+{
+    std::string ok = std::string("ok ") + cmd + " ";
+    size_t at = out.find(ok, mark);
+    if (at == std::string::npos || out.find('\n', at) == std::string::npos)
+        return false;
+    const char *p = out.c_str() + at + ok.size();
+    if (!strcmp(cmd, "test"))
+        p = strchr(p, ' ') + 1;     // past "10/10"
+    ms = strtod(p, NULL);
+    return true;
+}
+
+// System events seen by the session, us, 0 = not yet
+static uint64_t _poweringOnUs;
+static uint64_t _connectedUs;
+
+static void onNetEvent(system_event_t event, int param)
+{
+    sim::CC3000 &cc = sim::current();
+    if (param == network_status_powering_on && !_poweringOnUs)
+        _poweringOnUs = cc.now();
+    else if (param == network_status_connected && !_connectedUs)
+        _connectedUs = cc.now();
+}
+
+// done without a time when the batch command failed
+static bool failed(Session &s, double &ms)
+{
+    if (s.out.find("fail ", s.mark) == std::string::npos)
+        return false;
+    ms = NAN;
+    return true;
+}
+
+struct Bench {
+    const char *name;
+    const char *what;
+    const char *settings;       // script lines, ';' separated
+    const char *input;          // console input at t=0
+    uint32_t laterMs;           // when later is sent
+    const char *later;
+    bool zero;                  // anything but 0 fails, whatever the baseline
+    // after every pass through loop(), true with the time in ms once done
+    std::function<bool(Session &, double &)> done;
+};
+
+static const Bench benches[] = {
+    { "cold_start_ms", "power up to the menu on the console",
+      "", "x", 0, NULL, false,
+      [](Session &s, double &ms) {
+          if (s.out.find("--> ") == std::string::npos || !s.cc3000->serialIdle())
+              return false;
+          ms = s.now() / 1000.0;
+          return true;
+      } },
+    { "on_to_ready_ms", "CC3000 on to WiFi ready",
+      "bad_dns_rate 0", ">on; connect\n", 0, NULL, false,
+      [](Session &s, double &ms) {
+          if (!_connectedUs)
+              return failed(s, ms);
+          ms = (_connectedUs - _poweringOnUs) / 1000.0;
+          return true;
+      } },
+    { "dhcp_to_dns_ms", "DHCP lease to a valid DNS server in the network state",
+      "bad_dns_rate 0", ">on; connect\n", 0, NULL, false,
+      [](Session &s, double &ms) {
+          NetState net;
+          netStateRead(net);
+          if (!_connectedUs || !net.ready || !net.dnsSet || net.dnsBad)
+              return failed(s, ms);
+          ms = (s.now() - _connectedUs) / 1000.0;
+          return true;
+      } },
+    { "fixdns_recovery_ms", "Fix DNS from 76.83.0.0 to a good DNS server",
+      "bad_dns_rate 1; bad_dns_after_reset 0", ">on; connect; fixdns\n", 0, NULL, false,
+      [](Session &s, double &ms) {
+          return s.batchTime("fixdns", ms) || failed(s, ms);
+      } },
+    { "http_connect_ms", "connectHttpServerHost(), the mean of 10",
+      "bad_dns_rate 0", ">on; connect; test x10\n", 0, NULL, false,
+      [](Session &s, double &ms) {
+          if (!s.batchTime("test", ms))
+              return failed(s, ms);
+          ms /= 10;
+          return true;
+      } },
+    { "dump_ip_ms", "dumpIP() request to the last byte of the table on the console",
+      "bad_dns_rate 0", ">on; connect\n", 20000, "dump\n", false,
+      [](Session &s, double &ms) {
+          double _ms;
+          if (!s.batchTime("dump", _ms) || !s.cc3000->serialIdle())
+              return false;
+          ms = (s.now() - s.startUs) / 1000.0;
+          return true;
+      } },
+    { "menu_blocked_ms", "loop() blocked on console output drawing the status table and the largest menu",
+      "bad_dns_rate 1", "x1", 3000, "2", true,
+      [](Session &s, double &ms) {
+          size_t menu = s.out.find("] Fix DNS", s.mark);
+          if (menu == std::string::npos || s.out.find("--> ", menu) == std::string::npos ||
+              !s.cc3000->serialIdle())
+              return false;
+          ms = s.cc3000->stats().serial_blocked_us / 1000.0;
+          return true;
+      } },
+};
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+
+// one session in this process, the time in ms or NAN
+static double runSession(const Bench &b, sim::Config cfg, uint64_t seed)
+{
+    sim::Script script;
+    std::string err;
+    cfg.seed = seed;
+    cfg.run_ms = BENCH_RUN_MS;
+    cfg.idle_exit_ms = BENCH_RUN_MS;
+    cfg.echo_output = false;
+
+    std::string line;
+    for (const char *p = b.settings; ; p++)
+        if (*p == ';' || !*p) {
+            if (!line.empty() && !script.parseLine(cfg, line.c_str(), err)) {
+                fprintf(stderr, "%s: %s\n", b.name, err.c_str());
+                return NAN;
+            }
+            line.clear();
+            if (!*p)
+                break;
+        } else
+            line += *p;
+    sim::Script::Input in = { 0, b.input };
+    script.input.push_back(in);
+    if (b.later) {
+        sim::Script::Input later = { (uint64_t) b.laterMs * 1000, b.later };
+        script.input.push_back(later);
+    }
+
+    sim::CC3000 cc3000(cfg, script);
+    sim::bind(&cc3000);
+    cc3000.subscribe(network_status, onNetEvent);
+    Session s;
+    s.cc3000 = &cc3000;
+    s.mark = 0;
+    s.startUs = (uint64_t) b.laterMs * 1000;
+    cc3000.capture(&s.out);
+
+    double ms = NAN;
+    try {
+        setup();
+        for (;;) {
+            loop();
+            if (b.later && !s.mark && s.now() >= s.startUs)
+                s.mark = s.out.size();
+            if ((!b.later || s.mark) && b.done(s, ms))
+                break;
+            cc3000.step();
+        }
+    } catch (const sim::EndOfScript &) {
+    }
+    sim::bind(NULL);
+    return ms;
+}
+
+static double forkSession(const Bench &b, const sim::Config &cfg, uint64_t seed)
+{
+    int fd[2];
+    if (pipe(fd)) {
+        perror("pipe");
+        exit(2);
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(2);
+    }
+    if (!pid) {
+        close(fd[0]);
+        double ms = runSession(b, cfg, seed);
+        ssize_t n = write(fd[1], &ms, sizeof(ms));
+        _exit(n == sizeof(ms) ? 0 : 1);
+    }
+    close(fd[1]);
+    double ms = NAN;
+    if (read(fd[0], &ms, sizeof(ms)) != sizeof(ms))
+        ms = NAN;
+    close(fd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return ms;
+}
+
+/*
+ *  Results
+ */
+struct Result {
+    double median, p90, max, mean;
+    uint32_t failed;
+};
+
+static double rank(const std::vector<double> &sorted, double q)
+{
+    size_t i = (size_t) ceil(q * sorted.size());
+    return sorted[i ? i - 1 : 0];
+}
+
+static Result summarize(std::vector<double> &times)
+{
+    Result r = { NAN, NAN, NAN, NAN, 0 };
+    std::vector<double> ok;
+    for (size_t i = 0; i < times.size(); i++)
+        if (isnan(times[i]))
+            r.failed++;
+        else
+            ok.push_back(times[i]);
+    if (ok.empty())
+        return r;
+    std::sort(ok.begin(), ok.end());
+    double sum = 0;
+    for (size_t i = 0; i < ok.size(); i++)
+        sum += ok[i];
+    r.median = rank(ok, 0.5);
+    r.p90 = rank(ok, 0.9);
+    r.max = ok.back();
+    r.mean = sum / ok.size();
+    return r;
+}
+
+static void writeJson(FILE *f, uint32_t seeds, const Result *results)
+{
+    fprintf(f, "{\n  \"bench\": \"dnstest\",\n  \"seeds\": %u,\n  \"metrics\": {\n", seeds);
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        const Result &r = results[i];
+        fprintf(f, "    \"%s\": { \"median\": %.3f, \"p90\": %.3f, \"max\": %.3f, \"mean\": %.3f, \"failed\": %u }%s\n",
+            benches[i].name, r.median, r.p90, r.max, r.mean, r.failed, i + 1 < BENCH_COUNT ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+}
+
+// a number after "key": inside the object of a metric, NAN if it is not there
+static double baselineValue(const std::string &json, const char *metric, const char *key)
+{
+    size_t at = json.find(std::string("\"") + metric + "\"");
+    if (at == std::string::npos)
+        return NAN;
+    size_t end = json.find('}', at);
+    size_t k = json.find(std::string("\"") + key + "\":", at);
+    if (k == std::string::npos || k > end)
+        return NAN;
+    return strtod(json.c_str() + k + strlen(key) + 3, NULL);
+}
+
+static bool readFile(const char *path, std::string &text)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        text.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+// true when now is over base by more than the threshold and the slack
+static bool regressed(double now, double base, double percent)
+{
+    return !isnan(base) && now > base * (1 + percent / 100) && now - base >= BENCH_SLACK_MS;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n seeds] [-o out.json] [-b baseline.json] [-t percent] [setting=value ...]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    sim::Config cfg;
+    sim::Script script;
+    std::string err;
+    uint32_t seeds = 10;
+    const char *outPath = NULL;
+    const char *basePath = NULL;
+    double threshold = 10;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-n") && i + 1 < argc)
+            seeds = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (!strcmp(arg, "-o") && i + 1 < argc)
+            outPath = argv[++i];
+        else if (!strcmp(arg, "-b") && i + 1 < argc)
+            basePath = argv[++i];
+        else if (!strcmp(arg, "-t") && i + 1 < argc)
+            threshold = strtod(argv[++i], NULL);
+        else if (strchr(arg, '=') && arg[0] != '-') {
+            std::string line(arg);
+            for (size_t j = 0; j < line.size(); j++)
+                if (line[j] == '=' || line[j] == ',')
+                    line[j] = ' ';
+            if (!script.parseLine(cfg, line.c_str(), err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::string baseline;
+    if (basePath && !readFile(basePath, baseline)) {
+        fprintf(stderr, "cannot open %s\n", basePath);
+        return 2;
+    }
+
+    Result results[BENCH_COUNT];
+    bool slower = false;
+    bool unfinished = false;
+    fprintf(stderr, "%-20s %10s %10s %10s   %s\n", "", "median", "p90", "max", basePath ? "baseline median / p90" : "");
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        std::vector<double> times;
+        for (uint32_t seed = 1; seed <= seeds; seed++)
+            times.push_back(forkSession(benches[i], cfg, seed));
+        const Result &r = results[i] = summarize(times);
+
+        fprintf(stderr, "%-20s %10.3f %10.3f %10.3f", benches[i].name, r.median, r.p90, r.max);
+        if (basePath) {
+            double median = baselineValue(baseline, benches[i].name, "median");
+            double p90 = baselineValue(baseline, benches[i].name, "p90");
+            bool worse = regressed(r.median, median, threshold) || regressed(r.p90, p90, threshold);
+            fprintf(stderr, "   %.3f / %.3f%s", median, p90,
+                isnan(median) ? "  not in the baseline" : worse ? "  REGRESSED" : "");
+            slower |= worse;
+        }
+        if (r.failed)
+            fprintf(stderr, "  %u of %u did not finish", r.failed, seeds);
+        if (benches[i].zero && r.max > 0) {
+            fprintf(stderr, "  NOT 0");
+            unfinished = true;
+        }
+        fprintf(stderr, "  - %s\n", benches[i].what);
+        unfinished |= r.failed != 0;
+    }
+
+    FILE *f = outPath ? fopen(outPath, "w") : stdout;
+    if (!f) {
+        fprintf(stderr, "cannot write %s\n", outPath);
+        return 2;
+    }
+    writeJson(f, seeds, results);
+    if (outPath)
+        fclose(f);
+    if (slower)
+        fprintf(stderr, "slower than %s by more than %g%%\n", basePath, threshold);
+    return slower || unfinished ? 1 : 0;
+}
@@ -0,0 +1,1209 @@
+/*
+ *  cc3000_sim.cpp
+ *
+ *  Simulated CC3000, access point and serial console for the host build.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "cc3000_sim.h"
+#include "../firmware/Trace.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace sim {
+
+static const uint8_t kBadDNS[4] = { 76, 83, 0, 0 };   // the TI chip bad DNS
+
+static thread_local CC3000 *tl_current = NULL;
+
+CC3000 &current()
+{
+    if (!tl_current) {
+        fprintf(stderr, "sim: firmware API called with no simulator bound\n");
+        abort();
+    }
+    return *tl_current;
+}
+
+void bind(CC3000 *cc3000)
+{
+    tl_current = cc3000;
+}
+
+/*
+ *  Config and script parsing
+ */
+static void addHost(std::vector<HostEntry> &hosts, const char *name, uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+    HostEntry h;
+    h.name = name;
+    h.ip[0] = a; h.ip[1] = b; h.ip[2] = c; h.ip[3] = d;
+    h.ttl = 300;
+    hosts.push_back(h);
+}
+
+Config::Config()
+{
+    addHost(hosts, "data.sparkfun.com", 54, 86, 132, 254);
+    addHost(hosts, "device.spark.io", 54, 208, 229, 4);
+    addHost(hosts, "api.particle.io", 52, 0, 216, 18);
+    addHost(hosts, "www.google.com", 142, 250, 72, 4);
+    addHost(hosts, "example.com", 93, 184, 216, 34);
+}
+
+static bool parseIP(const char *s, uint8_t *ip)
+{
+    unsigned a, b, c, d;
+    char tail;
+    if (sscanf(s, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+        return false;
+    ip[0] = a; ip[1] = b; ip[2] = c; ip[3] = d;
+    return true;
+}
+
+static bool parseRange(const std::vector<std::string> &tok, Range &r)
+{
+    if (tok.size() < 2 || tok.size() > 3)
+        return false;
+    r.lo = strtoul(tok[1].c_str(), NULL, 10);
+    r.hi = tok.size() == 3 ? strtoul(tok[2].c_str(), NULL, 10) : r.lo;
+    return r.hi >= r.lo;
+}
+
+// Decode \r \n \t \\ and \xHH in a send line
+static std::string unescape(const char *s)
+{
+    std::string out;
+    while (*s) {
+        if (*s != '\\' || !s[1]) {
+            out += *s++;
+            continue;
+        }
+        ++s;
+        switch (*s) {
+            case 'r': out += '\r'; ++s; break;
+            case 'n': out += '\n'; ++s; break;
+            case 't': out += '\t'; ++s; break;
+            case 'x': {
+                char hex[3] = { s[1], (char) (s[1] ? s[2] : 0), 0 };
+                out += (char) strtoul(hex, NULL, 16);
+                s += 1 + strlen(hex);
+                break;
+            }
+            default: out += *s++; break;
+        }
+    }
+    return out;
+}
+
+/*
+ *  A recording dumped by the firmware's traceDumpBinary(), cut from a console
+ *  log or a file holding the log: the hex lines between "#dtr1" and "#end".
+ *  Only what the access point and the cloud did is kept - each lease, its
+ *  DNS server and how long both took, and the power up and cloud connect
+ *  times.  What the firmware did in between is for the firmware under test
+ *  to do again.
+ */
+static uint32_t msSince(uint64_t us, uint64_t since)
+{
+    return (uint32_t) ((us - since + 500) / 1000);
+}
+
+static bool loadReplay(const char *path, Config &cfg, std::string &err)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return err = std::string("cannot open ") + path, false;
+    std::vector<uint8_t> bytes;
+    char line[512];
+    unsigned long want = 0;
+    bool in = false, done = false;
+    while (!done && fgets(line, sizeof(line), f)) {
+        const char *p = strstr(line, "#dtr1 ");
+        if (!in) {
+            unsigned long headUs;
+            if (p && sscanf(p + 6, "%lu %lu", &headUs, &want) == 2)
+                in = true;
+            continue;
+        }
+        if (strstr(line, "#end")) {
+            done = true;
+            break;
+        }
+        for (p = line; isxdigit((unsigned char) p[0]) && isxdigit((unsigned char) p[1]); p += 2) {
+            char hex[3] = { p[0], p[1], 0 };
+            bytes.push_back((uint8_t) strtoul(hex, NULL, 16));
+        }
+    }
+    fclose(f);
+    if (!done)
+        return err = std::string("no #dtr1 ... #end recording in ") + path, false;
+    if (bytes.size() != want)
+        return err = std::string("truncated recording in ") + path, false;
+
+    Replay replay;
+    uint8_t config[5][4];               // as ip_config holds them, reversed
+    memset(config, 0, sizeof(config));
+    const uint64_t none = UINT64_MAX;
+    uint64_t us = 0, poweringOn = none, connecting = none, leased = none, cloudConnecting = none;
+    ReplayLease lease;
+    bool first = true;
+    size_t i = 0;
+    while (i < bytes.size()) {
+        uint32_t delta = 0;
+        int shift = 0;
+        do {
+            if (i >= bytes.size() || shift > 28)
+                return err = std::string("bad record in ") + path, false;
+            delta |= (uint32_t) (bytes[i] & 0x7F) << shift;
+            shift += 7;
+        } while (bytes[i++] & 0x80);
+        if (i + 2 > bytes.size())
+            return err = std::string("bad record in ") + path, false;
+        us += first ? 0 : delta;        // the first delta is from an evicted record
+        first = false;
+        uint8_t kind = bytes[i++];
+        uint8_t param = bytes[i++];
+
+        if (kind == REC_CONFIG) {
+            for (int k = 0; k < 5; k++)
+                if (param & (1 << k)) {
+                    if (i + 4 > bytes.size())
+                        return err = std::string("bad record in ") + path, false;
+                    memcpy(config[k], &bytes[i], 4);
+                    i += 4;
+                }
+            if (param & REC_SSID) {
+                uint8_t n = i < bytes.size() ? bytes[i] : 0xFF;
+                if (n >= sizeof(cfg.ssid) || i + 1 + n > bytes.size())
+                    return err = std::string("bad record in ") + path, false;
+                if (n) {
+                    memcpy(cfg.ssid, &bytes[i + 1], n);
+                    cfg.ssid[n] = 0;
+                }
+                i += 1 + n;
+            }
+            // the lease is complete once its DNS server shows up
+            if (leased != none && memcmp(config[4], "\0\0\0\0", 4)) {
+                uint8_t *fields[] = { lease.ip, lease.mask, lease.gw, lease.dhcp_server, lease.dns };
+                for (int k = 0; k < 5; k++)
+                    for (int b = 0; b < 4; b++)
+                        fields[k][b] = config[k][3 - b];
+                lease.dns_ms = msSince(us, leased);
+                replay.leases.push_back(lease);
+                leased = none;
+            }
+        } else if (kind == REC_NETWORK) {
+            switch (param) {
+                case network_status_powering_on:
+                    poweringOn = us;
+                    break;
+                case network_status_on:
+                    if (poweringOn != none)
+                        replay.power_on_ms.push_back(msSince(us, poweringOn));
+                    poweringOn = none;
+                    break;
+                case network_status_connecting:
+                    connecting = us;
+                    break;
+                case network_status_connected:
+                    memset(&lease, 0, sizeof(lease));
+                    lease.connect_ms = connecting != none ? msSince(us, connecting) : 0;
+                    connecting = none;
+                    leased = us;
+                    break;
+                case network_status_disconnected:
+                case network_status_off:
+                    if (leased != none) {
+                        // dropped before the DNS server came, the addresses are in the record
+                        uint8_t *fields[] = { lease.ip, lease.mask, lease.gw, lease.dhcp_server };
+                        for (int k = 0; k < 4; k++)
+                            for (int b = 0; b < 4; b++)
+                                fields[k][b] = config[k][3 - b];
+                        replay.leases.push_back(lease);
+                    }
+                    connecting = leased = none;
+                    break;
+            }
+        } else if (kind == REC_CLOUD) {
+            if (param == cloud_status_connecting)
+                cloudConnecting = us;
+            else if (param == cloud_status_connected && cloudConnecting != none) {
+                replay.cloud_ms.push_back(msSince(us, cloudConnecting));
+                cloudConnecting = none;
+            }
+        } else
+            return err = std::string("bad record in ") + path, false;
+    }
+    if (replay.empty())
+        return err = std::string("nothing to replay in ") + path, false;
+    cfg.replay = replay;
+    return true;
+}
+
+bool Script::parseLine(Config &cfg, const char *line, std::string &err)
+{
+    while (*line == ' ' || *line == '\t')
+        ++line;
+    if (!*line || *line == '#' || *line == '\n' || *line == '\r')
+        return true;
+
+    if (!strncmp(line, "set ", 4)) {
+        Config check(cfg);
+        if (!parseLine(check, line + 4, err))
+            return false;
+        Input in = { _cursor_us, line + 4 };
+        changes.push_back(in);
+        return true;
+    }
+
+    // "send" keeps the rest of the line verbatim
+    if (!strncmp(line, "send ", 5)) {
+        std::string text(line + 5);
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+            text.pop_back();
+        Input in = { _cursor_us, unescape(text.c_str()) };
+        input.push_back(in);
+        return true;
+    }
+
+    std::vector<std::string> tok;
+    const char *p = line;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            ++p;
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+            ++p;
+        if (p > start)
+            tok.push_back(std::string(start, p - start));
+    }
+    const std::string &key = tok[0];
+    const char *val = tok.size() > 1 ? tok[1].c_str() : "";
+    bool ok = tok.size() == 2;
+
+    struct { const char *name; Range *r; } ranges[] = {
+        { "power_on_ms", &cfg.power_on_ms },       { "power_off_ms", &cfg.power_off_ms },
+        { "assoc_ms", &cfg.assoc_ms },             { "dhcp_ms", &cfg.dhcp_ms },
+        { "dns_publish_ms", &cfg.dns_publish_ms }, { "disconnect_ms", &cfg.disconnect_ms },
+        { "clear_ms", &cfg.clear_ms },             { "cloud_ms", &cfg.cloud_ms },
+        { "nvmem_write_ms", &cfg.nvmem_write_ms }, { "dns_ms", &cfg.dns_ms },
+        { "tcp_connect_ms", &cfg.tcp_connect_ms }, { "server_ms", &cfg.server_ms },
+    };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+        if (key == ranges[i].name) {
+            if (!parseRange(tok, *ranges[i].r))
+                return err = "expected '" + key + " <min> [max]'", false;
+            return true;
+        }
+
+    struct { const char *name; uint32_t *v; } numbers[] = {
+        { "dns_timeout_ms", &cfg.dns_timeout_ms }, { "tcp_timeout_ms", &cfg.tcp_timeout_ms },
+        { "link_kbps", &cfg.link_kbps },           { "body_bytes", &cfg.body_bytes },
+        { "chunk_bytes", &cfg.chunk_bytes },       { "keepalive_ms", &cfg.keepalive_ms },
+        { "interim_100", &cfg.interim_100 },       { "poll_us", &cfg.poll_us },
+        { "loop_us", &cfg.loop_us },               { "serial_bps", &cfg.serial_bps },
+        { "serial_tx_buffer", &cfg.serial_tx_buffer }, { "serial_call_us", &cfg.serial_call_us },
+        { "idle_exit_ms", &cfg.idle_exit_ms },     { "run_ms", &cfg.run_ms },
+    };
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++)
+        if (key == numbers[i].name) {
+            if (!ok)
+                return err = "expected '" + key + " <value>'", false;
+            *numbers[i].v = strtoul(val, NULL, 10);
+            return true;
+        }
+
+    struct { const char *name; uint8_t *ip; } addrs[] = {
+        { "lease_ip", cfg.lease_ip }, { "lease_mask", cfg.lease_mask },
+        { "lease_gw", cfg.lease_gw }, { "lease_dns", cfg.lease_dns },
+    };
+    for (size_t i = 0; i < sizeof(addrs) / sizeof(addrs[0]); i++)
+        if (key == addrs[i].name) {
+            if (!ok || !parseIP(val, addrs[i].ip))
+                return err = "expected '" + key + " a.b.c.d'", false;
+            return true;
+        }
+
+    if (key == "seed" && ok)
+        cfg.seed = strtoull(val, NULL, 10);
+    else if (key == "bad_dns_rate" && ok)
+        cfg.bad_dns_rate = atof(val);
+    else if (key == "bad_dns_after_reset" && ok)
+        cfg.bad_dns_after_reset = atof(val);
+    else if (key == "max_sockets" && ok)
+        cfg.max_sockets = atoi(val);
+    else if (key == "has_credentials" && ok)
+        cfg.has_credentials = atoi(val) != 0;
+    else if (key == "rssi" && ok)
+        cfg.rssi = atoi(val);
+    else if (key == "ssid" && ok)
+        snprintf(cfg.ssid, sizeof(cfg.ssid), "%s", val);
+    else if (key == "verbose" && ok)
+        cfg.verbose = atoi(val) != 0;
+    else if (key == "echo" && ok)
+        cfg.echo_output = atoi(val) != 0;
+    else if (key == "gateway_dns" && ok)
+        cfg.gateway_dns = atoi(val) != 0;
+    else if (key == "host" && (tok.size() == 3 || tok.size() == 4)) {
+        HostEntry h;
+        h.name = tok[1];
+        h.ttl = tok.size() == 4 ? strtoul(tok[3].c_str(), NULL, 10) : 300;
+        if (!parseIP(tok[2].c_str(), h.ip))
+            return err = "expected 'host <name> a.b.c.d [ttl]'", false;
+        cfg.hosts.push_back(h);
+    }
+    else if (key == "dns_server" && tok.size() >= 3 && tok.size() <= 4) {
+        DnsServer d;
+        std::vector<std::string> range(tok.begin() + 1, tok.end());
+        if (!parseIP(tok[1].c_str(), d.ip) || !parseRange(range, d.ms))
+            return err = "expected 'dns_server a.b.c.d <min> [max]'", false;
+        cfg.dns_servers.push_back(d);
+    }
+    else if (key == "replay" && ok) {
+        if (!loadReplay(val, cfg, err))
+            return false;
+    }
+    else if (key == "wait" && ok)
+        _cursor_us += strtoull(val, NULL, 10) * 1000;
+    else if (key == "at" && ok)
+        _cursor_us = strtoull(val, NULL, 10) * 1000;
+    else
+        return err = "unknown or malformed setting '" + key + "'", false;
+    return true;
+}
+
+bool Script::load(Config &cfg, const char *path, std::string &err)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return err = std::string("cannot open ") + path, false;
+    char line[512];
+    int n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ++n;
+        if (!parseLine(cfg, line, err)) {
+            char where[32];
+            snprintf(where, sizeof(where), ":%d: ", n);
+            err = path + std::string(where) + err;
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+/*
+ *  Simulator
+ */
+CC3000::CC3000(const Config &cfg, const Script &script)
+    : _cfg(cfg), _rng(cfg.seed), _now(0), _seq(0),
+      _power(false), _link(LINK_DOWN), _linkEpoch(0),
+      _credentials(cfg.has_credentials), _listening(false),
+      _dhcp(true), _dhcpReset(false),
+      _cloud(CLOUD_DOWN), _cloudWanted(false), _cloudEpoch(0),
+      _notifying(false), _input(script.input), _changes(script.changes), _changePos(0), _inputPos(0), _inputOffset(0), _lastActivity(0), _baud(0),
+      _txQueued(0), _txDrained(0), _capture(NULL),
+      _lease(NULL), _replayLease(0), _replayPowerOn(0), _replayCloud(0)
+{
+    memset(&ipConfig, 0, sizeof(ipConfig));
+    memset(_static, 0, sizeof(_static));
+    memset(_pendingDns, 0, sizeof(_pendingDns));
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_eeprom, 0xFF, sizeof(_eeprom));
+
+    // TI OUI, rest of the address from the seed; uaMacAddr is stored reversed
+    uint64_t r = _rng();
+    uint8_t mac[6] = { 0x08, 0x00, 0x28, (uint8_t) (r >> 16), (uint8_t) (r >> 8), (uint8_t) r };
+    for (int i = 0; i < 6; i++)
+        ipConfig.uaMacAddr[i] = mac[5 - i];
+}
+
+uint32_t CC3000::draw(const Range &r)
+{
+    if (r.hi <= r.lo)
+        return r.lo;
+    return r.lo + (uint32_t) (_rng() % (r.hi - r.lo + 1));
+}
+
+bool CC3000::chance(double p)
+{
+    if (p <= 0.0)
+        return false;
+    return std::uniform_real_distribution<double>(0.0, 1.0)(_rng) < p;
+}
+
+void CC3000::log(const char *fmt, ...)
+{
+    if (!_cfg.verbose)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[%10.3f] cc3000: ", _now / 1e6);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+void CC3000::schedule(uint32_t ms, EventKind kind)
+{
+    Event ev;
+    ev.at = _now + (uint64_t) ms * 1000;
+    ev.seq = _seq++;
+    ev.kind = kind;
+    ev.epoch = (kind == EV_CLOUD_UP || kind == EV_CLOUD_DOWN) ? _cloudEpoch : _linkEpoch;
+    _events.push(ev);
+}
+
+void CC3000::advance(uint64_t us)
+{
+    uint64_t target = _now + us;
+    for (;;) {
+        uint64_t change = _changePos < _changes.size() ? _changes[_changePos].at_us : UINT64_MAX;
+        uint64_t event = _events.empty() ? UINT64_MAX : _events.top().at;
+        if (change > target && event > target)
+            break;
+        if (change <= event) {
+            // scheduled setting, parsed when the script was loaded
+            Script _script;
+            std::string _err;
+            if (change > _now)
+                _now = change;
+            _script.parseLine(_cfg, _changes[_changePos++].bytes.c_str(), _err);
+            log("set %s", _changes[_changePos - 1].bytes.c_str());
+            continue;
+        }
+        Event ev = _events.top();
+        _events.pop();
+        if (ev.at > _now)
+            _now = ev.at;
+        handle(ev);
+    }
+    _now = target;
+    if (_cfg.run_ms && _now >= (uint64_t) _cfg.run_ms * 1000)
+        throw EndOfScript();
+}
+
+static void reversed(unsigned char *dst, const uint8_t *src)
+{
+    dst[0] = src[3]; dst[1] = src[2]; dst[2] = src[1]; dst[3] = src[0];
+}
+
+void CC3000::handle(const Event &ev)
+{
+    bool cloudEvent = ev.kind == EV_CLOUD_UP || ev.kind == EV_CLOUD_DOWN;
+    if (ev.epoch != (cloudEvent ? _cloudEpoch : _linkEpoch))
+        return;     // superseded by a later connect/disconnect
+
+    switch (ev.kind) {
+        case EV_ASSOCIATED:
+            log("associated with %s", _cfg.ssid);
+            _link = LINK_LEASING;
+            if (_lease)     // the recorded connect time covers the DHCP exchange
+                schedule(_lease->connect_ms ? 0 : draw(_cfg.dhcp_ms), EV_LEASED);
+            else
+                schedule(_dhcp ? draw(_cfg.dhcp_ms) : 5, EV_LEASED);
+            break;
+
+        case EV_LEASED: {
+            const uint8_t *ip = _lease ? _lease->ip : _dhcp ? _cfg.lease_ip : _static[0];
+            const uint8_t *mask = _lease ? _lease->mask : _dhcp ? _cfg.lease_mask : _static[1];
+            const uint8_t *gw = _lease ? _lease->gw : _dhcp ? _cfg.lease_gw : _static[2];
+            reversed(ipConfig.aucIP, ip);
+            reversed(ipConfig.aucSubnetMask, mask);
+            reversed(ipConfig.aucDefaultGateway, gw);
+            reversed(ipConfig.aucDHCPServer, _lease ? _lease->dhcp_server : gw);
+            memset(ipConfig.uaSSID, 0, sizeof(ipConfig.uaSSID));
+            memcpy(ipConfig.uaSSID, _cfg.ssid, strlen(_cfg.ssid));
+
+            bool bad = false;
+            if (_lease) {
+                memcpy(_pendingDns, _lease->dns, 4);
+                bad = !memcmp(_lease->dns, kBadDNS, 4);
+            } else if (_dhcp) {
+                bad = chance(_dhcpReset ? _cfg.bad_dns_after_reset : _cfg.bad_dns_rate);
+                memcpy(_pendingDns, bad ? kBadDNS : _cfg.lease_dns, 4);
+            } else
+                memcpy(_pendingDns, _static[3], 4);
+            _dhcpReset = false;
+            _stats.leases++;
+            if (bad)
+                _stats.bad_leases++;
+            log("%s lease %u.%u.%u.%u dns %u.%u.%u.%u", _dhcp ? "dhcp" : "static",
+                ip[0], ip[1], ip[2], ip[3], _pendingDns[0], _pendingDns[1], _pendingDns[2], _pendingDns[3]);
+            _link = LINK_UP;
+            if (!_lease)
+                schedule(draw(_cfg.dns_publish_ms), EV_DNS_PUBLISHED);
+            else if (memcmp(_lease->dns, "\0\0\0\0", 4))
+                schedule(_lease->dns_ms, EV_DNS_PUBLISHED);     // else the recorded lease never got one
+            notify(network_status, network_status_connected);
+            checkCloud();
+            break;
+        }
+
+        case EV_DNS_PUBLISHED:
+            reversed(ipConfig.aucDNSServer, _pendingDns);
+            break;
+
+        case EV_LINK_DOWN:
+            dropLink("disconnected");
+            break;
+
+        case EV_CONFIG_CLEARED:
+            memset(ipConfig.aucIP, 0, 4);
+            memset(ipConfig.aucSubnetMask, 0, 4);
+            memset(ipConfig.aucDefaultGateway, 0, 4);
+            memset(ipConfig.aucDHCPServer, 0, 4);
+            memset(ipConfig.aucDNSServer, 0, 4);
+            memset(ipConfig.uaSSID, 0, sizeof(ipConfig.uaSSID));
+            break;
+
+        case EV_CLOUD_UP:
+            if (_link == LINK_UP) {
+                _cloud = CLOUD_UP;
+                _stats.cloud_connects++;
+                log("cloud connected");
+                notify(cloud_status, cloud_status_connected);
+            }
+            break;
+
+        case EV_CLOUD_DOWN:
+            _cloud = CLOUD_DOWN;
+            log("cloud disconnected");
+            notify(cloud_status, cloud_status_disconnected);
+            break;
+    }
+}
+
+void CC3000::dropLink(const char *why)
+{
+    bool wasUp = _link != LINK_DOWN;
+    if (wasUp)
+        log("link down (%s)", why);
+    _link = LINK_DOWN;
+    if (_cloud != CLOUD_DOWN) {
+        _cloud = CLOUD_DOWN;
+        _cloudEpoch++;
+        notify(cloud_status, cloud_status_disconnected);
+    }
+    if (wasUp)
+        notify(network_status, network_status_disconnected);
+    if (!_power)
+        notify(network_status, network_status_off);
+    for (size_t i = 0; i < _sockets.size(); i++) {
+        _sockets[i].connected = false;
+        _sockets[i].datagrams.clear();
+    }
+    schedule(draw(_cfg.clear_ms), EV_CONFIG_CLEARED);
+}
+
+void CC3000::checkCloud()
+{
+    if (_cloudWanted && _link == LINK_UP && _cloud == CLOUD_DOWN) {
+        _cloud = CLOUD_CONNECTING;
+        _cloudEpoch++;
+        schedule(replayed(_cfg.replay.cloud_ms, _replayCloud, _cfg.cloud_ms), EV_CLOUD_UP);
+        notify(cloud_status, cloud_status_connecting);
+    }
+}
+
+bool CC3000::subscribe(system_event_t events, system_event_handler_t handler)
+{
+    if (!handler)
+        return false;
+    Subscriber sub = { events, handler };
+    _subscribers.push_back(sub);
+    return true;
+}
+
+void CC3000::notify(system_event_t event, int param)
+{
+    _notifyQueue.push_back(std::make_pair(event, param));
+    if (_notifying)
+        return;
+    _notifying = true;
+    while (!_notifyQueue.empty()) {
+        std::pair<system_event_t, int> ev = _notifyQueue.front();
+        _notifyQueue.pop_front();
+        for (size_t i = 0; i < _subscribers.size(); i++)
+            if (_subscribers[i].events & ev.first)
+                _subscribers[i].handler(ev.first, ev.second);
+    }
+    _notifying = false;
+}
+
+/*
+ *  The next recorded time, or one from the model once the recording has run out
+ */
+uint32_t CC3000::replayed(const std::vector<uint32_t> &ms, size_t &next, const Range &model)
+{
+    if (next < ms.size()) {
+        _stats.replayed++;
+        return ms[next++];
+    }
+    if (!_cfg.replay.empty())
+        _stats.replay_beyond++;
+    return draw(model);
+}
+
+void CC3000::powerOn()
+{
+    if (_power)
+        return;
+    notify(network_status, network_status_powering_on);
+    advance(replayed(_cfg.replay.power_on_ms, _replayPowerOn, _cfg.power_on_ms) * 1000ULL);
+    _power = true;
+    _listening = false;
+    _stats.radio_starts++;
+    log("powered on");
+    notify(network_status, network_status_on);
+}
+
+void CC3000::powerOff()
+{
+    if (!_power)
+        return;
+    _power = false;
+    _listening = false;
+    _linkEpoch++;
+    log("powering off");
+    notify(network_status, network_status_powering_off);
+    if (_link != LINK_DOWN)
+        schedule(draw(_cfg.power_off_ms), EV_LINK_DOWN);
+    else {
+        schedule(draw(_cfg.clear_ms), EV_CONFIG_CLEARED);
+        notify(network_status, network_status_off);
+    }
+}
+
+void CC3000::connect()
+{
+    if (!_power)
+        powerOn();
+    if (_link != LINK_DOWN)
+        return;
+    _linkEpoch++;
+    if (!_credentials) {
+        _listening = true;
+        log("no credentials, listening");
+        return;
+    }
+    log("associating");
+    _link = LINK_ASSOCIATING;
+    // each connect takes the next recorded lease, so how often the firmware
+    // reconnects decides how far through the recording it gets
+    _lease = NULL;
+    if (_dhcp && _replayLease < _cfg.replay.leases.size()) {
+        _leaseCopy = _cfg.replay.leases[_replayLease++];
+        _lease = &_leaseCopy;
+        _stats.replayed++;
+    } else if (_dhcp && !_cfg.replay.empty())
+        _stats.replay_beyond++;
+    schedule(_lease && _lease->connect_ms ? _lease->connect_ms : draw(_cfg.assoc_ms), EV_ASSOCIATED);
+    notify(network_status, network_status_connecting);
+}
+
+void CC3000::disconnect()
+{
+    if (_link == LINK_DOWN)
+        return;
+    _linkEpoch++;
+    notify(network_status, network_status_disconnecting);
+    if (_link != LINK_UP)
+        dropLink("association abandoned");
+    else
+        schedule(draw(_cfg.disconnect_ms), EV_LINK_DOWN);
+}
+
+const char *CC3000::ssid() const
+{
+    return ready() ? _cfg.ssid : "";
+}
+
+int8_t CC3000::rssi()
+{
+    if (!ready())
+        return 0;
+    return (int8_t) (_cfg.rssi + (int) (_rng() % 7) - 3);
+}
+
+void CC3000::macAddress(uint8_t *mac) const
+{
+    for (int i = 0; i < 6; i++)
+        mac[i] = ipConfig.uaMacAddr[5 - i];
+}
+
+long CC3000::setDhcp(const uint8_t *ip, const uint8_t *mask, const uint8_t *gw, const uint8_t *dns)
+{
+    if (!_power)
+        return -1;
+    advance(draw(_cfg.nvmem_write_ms) * 1000ULL);
+    _stats.nvmem_writes++;
+    static const uint8_t zero[4] = { 0, 0, 0, 0 };
+    _dhcp = !memcmp(ip, zero, 4);
+    _dhcpReset = _dhcp;
+    memcpy(_static[0], ip, 4);
+    memcpy(_static[1], mask, 4);
+    memcpy(_static[2], gw, 4);
+    memcpy(_static[3], dns, 4);
+    log("netapp_dhcp %s", _dhcp ? "dhcp" : "static");
+    return 0;
+}
+
+uint8_t CC3000::eepromRead(int addr) const
+{
+    return addr >= 0 && addr < EEPROM_SIZE ? _eeprom[addr] : 0xFF;
+}
+
+void CC3000::eepromWrite(int addr, uint8_t value)
+{
+    if (addr < 0 || addr >= EEPROM_SIZE)
+        return;
+    _eeprom[addr] = value;
+    _stats.eeprom_writes++;
+}
+
+void CC3000::wlanStop()
+{
+    _power = false;
+    _listening = false;
+    _linkEpoch++;
+    dropLink("wlan_stop");
+    log("wlan_stop");
+}
+
+void CC3000::wlanStart()
+{
+    _power = false;
+    powerOn();
+}
+
+void CC3000::cloudConnect()
+{
+    _cloudWanted = true;
+    if (_link == LINK_DOWN)
+        connect();
+    checkCloud();
+}
+
+void CC3000::cloudDisconnect()
+{
+    _cloudWanted = false;
+    if (_cloud == CLOUD_DOWN)
+        return;
+    _cloudEpoch++;
+    schedule(draw(_cfg.disconnect_ms), EV_CLOUD_DOWN);
+    notify(cloud_status, cloud_status_disconnecting);
+}
+
+/*
+ *  Name resolution and sockets
+ */
+const HostEntry *CC3000::findHost(const char *name) const
+{
+    for (size_t i = 0; i < _cfg.hosts.size(); i++)
+        if (!strcasecmp(_cfg.hosts[i].name.c_str(), name))
+            return &_cfg.hosts[i];
+    return NULL;
+}
+
+const HostEntry *CC3000::findHost(const uint8_t *ip) const
+{
+    for (size_t i = 0; i < _cfg.hosts.size(); i++)
+        if (!memcmp(_cfg.hosts[i].ip, ip, 4))
+            return &_cfg.hosts[i];
+    return NULL;
+}
+
+bool CC3000::resolve(const char *host, uint8_t *ip)
+{
+    if (parseIP(host, ip))
+        return true;
+    _stats.dns_queries++;
+    if (!ready()) {
+        _stats.dns_failures++;
+        return false;
+    }
+
+    uint8_t server[4];
+    reversed(server, ipConfig.aucDNSServer);
+    static const uint8_t zero[4] = { 0, 0, 0, 0 };
+    if (!memcmp(server, kBadDNS, 4) || !memcmp(server, zero, 4)) {
+        // nobody answers at 76.83.0.0, gethostbyname() runs into its timeout
+        advance(_cfg.dns_timeout_ms * 1000ULL);
+        _stats.dns_failures++;
+        log("resolve %s: timeout", host);
+        return false;
+    }
+
+    advance(draw(_cfg.dns_ms) * 1000ULL);
+    const HostEntry *h = findHost(host);
+    if (!h) {
+        _stats.dns_failures++;
+        log("resolve %s: NXDOMAIN", host);
+        return false;
+    }
+    memcpy(ip, h->ip, 4);
+    return true;
+}
+
+int CC3000::socketOpen()
+{
+    int inUse = 0;
+    for (size_t i = 0; i < _sockets.size(); i++)
+        if (_sockets[i].open)
+            inUse++;
+    if (!_power || inUse >= _cfg.max_sockets)
+        return -1;
+
+    size_t i = 0;
+    while (i < _sockets.size() && _sockets[i].open)
+        i++;
+    if (i == _sockets.size())
+        _sockets.push_back(Socket());
+    Socket &s = _sockets[i];
+    s.open = true;
+    s.connected = false;
+    memset(s.ip, 0, sizeof(s.ip));
+    s.datagrams.clear();
+    s.port = 0;
+    s.request.clear();
+    s.response.clear();
+    s.rx_pos = 0;
+    s.first_byte_at = 0;
+    s.closing = false;
+    s.idle_close_at = 0;
+    return (int) i;
+}
+
+int CC3000::socketConnect(int sock, const uint8_t *ip, uint16_t port)
+{
+    Socket &s = _sockets[sock];
+    if (!ready()) {
+        poll();
+        _stats.tcp_failures++;
+        return 0;
+    }
+    const HostEntry *h = findHost(ip);
+    if (!h) {
+        advance(_cfg.tcp_timeout_ms * 1000ULL);
+        _stats.tcp_failures++;
+        log("connect %u.%u.%u.%u:%u: timeout", ip[0], ip[1], ip[2], ip[3], port);
+        return 0;
+    }
+    advance(draw(_cfg.tcp_connect_ms) * 1000ULL);
+    if (!ready()) {
+        _stats.tcp_failures++;
+        return 0;
+    }
+    s.connected = true;
+    memcpy(s.ip, h->ip, 4);
+    s.port = port;
+    _stats.tcp_connects++;
+    return 1;
+}
+
+void CC3000::serveRequest(Socket &s)
+{
+    char path[128];
+    char head[160];
+    std::string body;
+
+    // HTTP/1.1 keeps the connection unless the request asks to close it
+    bool keep = _cfg.keepalive_ms && s.request.find(" HTTP/1.1") != std::string::npos &&
+                strcasestr(s.request.c_str(), "Connection: close") == NULL;
+    const char *connection = keep ? "keep-alive" : "close";
+
+    if (sscanf(s.request.c_str(), "GET %127s HTTP/1.%*c", path) == 1 && s.request.find(" HTTP/1.") != std::string::npos) {
+        if (_cfg.chunk_bytes) {
+            char size[16];
+            for (uint32_t left = _cfg.body_bytes; left; ) {
+                uint32_t n = left < _cfg.chunk_bytes ? left : _cfg.chunk_bytes;
+                snprintf(size, sizeof(size), "%x\r\n", (unsigned) n);
+                body += size;
+                body.append(n, 'x');
+                body += "\r\n";
+                left -= n;
+            }
+            body += "0\r\n\r\n";
+            snprintf(head, sizeof(head),
+                "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nTransfer-Encoding: chunked\r\nConnection: %s\r\n\r\n",
+                connection);
+        } else {
+            body.assign(_cfg.body_bytes, 'x');
+            snprintf(head, sizeof(head),
+                "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: %s\r\n\r\n",
+                (unsigned) body.size(), connection);
+        }
+    } else
+        snprintf(head, sizeof(head), "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+            connection);
+
+    // one request at a time - a new one drops what is left of the last response
+    s.response = std::string(_cfg.interim_100 ? "HTTP/1.1 100 Continue\r\n\r\n" : "") + head + body;
+    s.rx_pos = 0;
+    s.first_byte_at = _now + draw(_cfg.server_ms) * 1000ULL;
+    s.closing = !keep;
+    s.idle_close_at = keep ? s.first_byte_at + s.response.size() * 8000ULL / _cfg.link_kbps + _cfg.keepalive_ms * 1000ULL : 0;
+    s.request.clear();
+}
+
+int CC3000::socketWrite(int sock, const uint8_t *buf, size_t len)
+{
+    Socket &s = _sockets[sock];
+    poll();
+    if (!socketConnected(sock))
+        return -1;
+    s.request.append((const char *) buf, len);
+    if (s.request.find("\n\n") != std::string::npos || s.request.find("\r\n\r\n") != std::string::npos)
+        serveRequest(s);
+    return (int) len;
+}
+
+size_t CC3000::socketArrived(const Socket &s) const
+{
+    if (s.response.empty() || _now < s.first_byte_at)
+        return 0;
+    uint64_t bytes = 1 + (_now - s.first_byte_at) * _cfg.link_kbps / 8000;
+    return bytes < s.response.size() ? (size_t) bytes : s.response.size();
+}
+
+int CC3000::socketAvailable(int sock)
+{
+    poll();
+    const Socket &s = _sockets[sock];
+    if (!s.open)
+        return 0;
+    return (int) (socketArrived(s) - s.rx_pos);
+}
+
+int CC3000::socketRead(int sock, uint8_t *buf, size_t len, bool peek)
+{
+    Socket &s = _sockets[sock];
+    if (!s.open)
+        return 0;
+    size_t n = socketArrived(s) - s.rx_pos;
+    if (n > len)
+        n = len;
+    memcpy(buf, s.response.data() + s.rx_pos, n);
+    if (!peek)
+        s.rx_pos += n;
+    return (int) n;
+}
+
+bool CC3000::socketConnected(int sock)
+{
+    Socket &s = _sockets[sock];
+    if (!s.open || !s.connected)
+        return false;
+    if (s.closing && socketArrived(s) == s.response.size() && s.rx_pos == s.response.size())
+        s.connected = false;    // server closed after sending the response
+    else if (s.idle_close_at && _now >= s.idle_close_at) {
+        s.connected = false;    // keep-alive connection idle too long
+        log("server closed idle keep-alive connection");
+    }
+    return s.connected;
+}
+
+void CC3000::socketClose(int sock)
+{
+    if (sock >= 0 && (size_t) sock < _sockets.size()) {
+        _sockets[sock].open = false;
+        _sockets[sock].connected = false;
+    }
+}
+
+/*
+ *  UDP - only DNS queries get an answer
+ */
+bool CC3000::dnsAnswer(const uint8_t *server, const uint8_t *query, size_t len, Datagram &reply)
+{
+    Range ms = _cfg.dns_ms;
+    uint8_t dhcpDns[4];
+    reversed(dhcpDns, ipConfig.aucDNSServer);
+    bool answers = !memcmp(server, dhcpDns, 4) && memcmp(server, kBadDNS, 4) && (server[0] || server[1]);
+    if (_cfg.gateway_dns && !memcmp(server, _dhcp ? _cfg.lease_gw : _static[2], 4))
+        answers = true;
+    for (size_t i = 0; i < _cfg.dns_servers.size(); i++)
+        if (!memcmp(server, _cfg.dns_servers[i].ip, 4)) {
+            answers = true;
+            ms = _cfg.dns_servers[i].ms;
+        }
+    if (!answers || len < 17)
+        return false;
+
+    // question: one name, QTYPE, QCLASS
+    std::string name;
+    size_t pos = 12;
+    while (pos < len && query[pos]) {
+        uint8_t l = query[pos];
+        if (l > 63 || pos + 1 + l >= len)
+            return false;
+        if (!name.empty())
+            name += '.';
+        name.append((const char *) query + pos + 1, l);
+        pos += 1 + l;
+    }
+    pos += 5;
+    if (pos > len)
+        return false;
+
+    const HostEntry *h = findHost(name.c_str());
+    std::string &r = reply.data;
+    r.assign((const char *) query, pos);
+    r[2] = (char) 0x81;                         // QR, RD
+    r[3] = (char) (h ? 0x80 : 0x83);            // RA, NXDOMAIN if unknown
+    r[6] = 0; r[7] = h ? 1 : 0;                 // ANCOUNT
+    r[8] = r[9] = r[10] = r[11] = 0;
+    if (h) {
+        const uint8_t rr[] = {
+            0xC0, 0x0C, 0, 1, 0, 1,
+            (uint8_t) (h->ttl >> 24), (uint8_t) (h->ttl >> 16), (uint8_t) (h->ttl >> 8), (uint8_t) h->ttl,
+            0, 4, h->ip[0], h->ip[1], h->ip[2], h->ip[3]
+        };
+        r.append((const char *) rr, sizeof(rr));
+    }
+    reply.at = _now + draw(ms) * 1000ULL;
+    memcpy(reply.ip, server, 4);
+    reply.port = 53;
+    _stats.dns_queries++;
+    if (!h)
+        _stats.dns_failures++;
+    return true;
+}
+
+int CC3000::udpSend(int sock, const uint8_t *ip, uint16_t port, const uint8_t *buf, size_t len)
+{
+    poll();
+    Socket &s = _sockets[sock];
+    if (!s.open || !ready())
+        return -1;
+    Datagram reply;
+    if (port == 53 && dnsAnswer(ip, buf, len, reply))
+        s.datagrams.push_back(reply);
+    else if (port == 53)
+        log("dns query to %u.%u.%u.%u: no answer", ip[0], ip[1], ip[2], ip[3]);
+    return (int) len;
+}
+
+int CC3000::udpReceive(int sock, uint8_t *buf, size_t len, uint8_t *ip, uint16_t *port)
+{
+    poll();
+    Socket &s = _sockets[sock];
+    size_t next = s.datagrams.size();
+    for (size_t i = 0; i < s.datagrams.size(); i++)
+        if (s.datagrams[i].at <= _now && (next == s.datagrams.size() || s.datagrams[i].at < s.datagrams[next].at))
+            next = i;
+    if (!s.open || next == s.datagrams.size())
+        return 0;
+    const Datagram &d = s.datagrams[next];
+    size_t n = d.data.size() < len ? d.data.size() : len;
+    memcpy(buf, d.data.data(), n);
+    memcpy(ip, d.ip, 4);
+    *port = d.port;
+    s.datagrams.erase(s.datagrams.begin() + next);
+    return (int) n;
+}
+
+/*
+ *  Serial console
+ */
+int CC3000::serialAvailable()
+{
+    poll();
+    while (_inputPos < _input.size() && _inputOffset >= _input[_inputPos].bytes.size()) {
+        _inputPos++;
+        _inputOffset = 0;
+    }
+    size_t n = 0;
+    for (size_t i = _inputPos; i < _input.size() && _input[i].at_us <= _now; i++)
+        n += _input[i].bytes.size() - (i == _inputPos ? _inputOffset : 0);
+    if (!n && _inputPos >= _input.size() && _now - _lastActivity > (uint64_t) _cfg.idle_exit_ms * 1000)
+        throw EndOfScript();
+    return (int) n;
+}
+
+int CC3000::serialRead(bool peek)
+{
+    while (_inputPos < _input.size() && _inputOffset >= _input[_inputPos].bytes.size()) {
+        _inputPos++;
+        _inputOffset = 0;
+    }
+    if (_inputPos >= _input.size() || _input[_inputPos].at_us > _now)
+        return -1;
+    int c = (unsigned char) _input[_inputPos].bytes[_inputOffset];
+    if (!peek) {
+        _inputOffset++;
+        _lastActivity = _now;
+    }
+    return c;
+}
+
+// The FIFO drains at 10 bits per byte; without a line rate it never fills
+void CC3000::serialDrain()
+{
+    uint32_t bps = _cfg.serial_bps ? _cfg.serial_bps : (uint32_t) _baud;
+    if (!bps) {
+        _txQueued = 0;
+        _txDrained = _now;
+        return;
+    }
+    uint64_t sent = (_now - _txDrained) * bps / 10000000ULL;
+    if (sent >= _txQueued) {
+        _txQueued = 0;
+        _txDrained = _now;
+    } else if (sent) {
+        _txQueued -= (uint32_t) sent;
+        _txDrained += sent * 10000000ULL / bps;
+    }
+}
+
+bool CC3000::serialIdle()
+{
+    serialDrain();
+    return !_txQueued;
+}
+
+int CC3000::serialAvailableForWrite()
+{
+    poll();
+    serialDrain();
+    return (int) (_cfg.serial_tx_buffer - _txQueued);
+}
+
+size_t CC3000::serialWrite(const uint8_t *buf, size_t len)
+{
+    advance(_cfg.serial_call_us);
+    uint64_t start = _now;
+    for (size_t left = len; left; ) {
+        serialDrain();
+        uint32_t room = _cfg.serial_tx_buffer - _txQueued;
+        if (!room) {
+            // blocked until the next byte is out
+            uint32_t bps = _cfg.serial_bps ? _cfg.serial_bps : (uint32_t) _baud;
+            advance(10000000ULL / bps + 1);
+            continue;
+        }
+        uint32_t n = left < room ? (uint32_t) left : room;
+        if (!_txQueued)
+            _txDrained = _now;
+        _txQueued += n;
+        left -= n;
+    }
+    _stats.serial_blocked_us += _now - start;
+    _stats.serial_writes++;
+    if (_cfg.echo_output)
+        fwrite(buf, 1, len, stdout);
+    if (_capture)
+        _capture->append((const char *) buf, len);
+    _stats.serial_tx_bytes += len;
+    _lastActivity = _now;
+    return len;
+}
+
+}  // namespace sim
@@ -0,0 +1,357 @@
+/*
+ *  cc3000_sim.h
+ *
+ *  Scriptable simulation of a Spark Core's CC3000, the access point it talks
+ *  to and the serial console, used by the host build of DNSTest.
+ *
+ *  The simulator owns a microsecond clock.  Nothing happens on its own; the
+ *  clock moves forward when the firmware calls delay(), polls the hardware,
+ *  or when the host runner steps between calls to loop().  Radio, DHCP,
+ *  name resolution and socket latencies are drawn from configurable ranges
+ *  using a seeded generator, so a given script and seed always replays the
+ *  same way.
+ *
+ *  The failure being diagnosed - a DHCP lease that leaves the CC3000 with
+ *  76.83.0.0 as its DNS server - is produced at a configurable rate.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#ifndef CC3000_SIM_H_
+#define CC3000_SIM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <queue>
+#include <deque>
+
+#include "application.h"
+
+namespace sim {
+
+// Thrown out of the firmware once the input script is exhausted and the
+// console has been quiet for idle_exit_ms, or when run_ms is reached.
+struct EndOfScript {};
+
+// Inclusive latency range in milliseconds
+struct Range {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+struct HostEntry {
+    std::string name;
+    uint8_t ip[4];      // network order, ip[0] is the first octet
+    uint32_t ttl;       // s, reported by the DNS servers
+};
+
+// A DNS server reachable over UDP besides the one handed out by DHCP
+struct DnsServer {
+    uint8_t ip[4];
+    Range ms;
+};
+
+// What a field recording (Trace.h) says the access point and the cloud did -
+// every lease with its timing, the CC3000 power up and cloud connect times,
+// each in recorded order
+struct ReplayLease {
+    uint32_t connect_ms;        // WiFi connecting to connected, 0 = not recorded
+    uint32_t dns_ms;            // lease to the DNS server in ip_config
+    uint8_t ip[4];
+    uint8_t mask[4];
+    uint8_t gw[4];
+    uint8_t dhcp_server[4];
+    uint8_t dns[4];             // 0.0.0.0 - the DNS server never came
+};
+
+struct Replay {
+    std::vector<ReplayLease> leases;
+    std::vector<uint32_t> power_on_ms;
+    std::vector<uint32_t> cloud_ms;
+    bool empty() const { return leases.empty() && power_on_ms.empty() && cloud_ms.empty(); }
+};
+
+struct Config {
+    uint64_t seed = 1;
+
+    // radio and access point
+    Range power_on_ms       { 250, 600 };
+    Range power_off_ms      { 50, 200 };
+    Range assoc_ms          { 1200, 3500 };
+    Range dhcp_ms           { 300, 2500 };
+    Range dns_publish_ms    { 20, 300 };    // aucDNSServer lags WiFi.ready()
+    Range disconnect_ms     { 100, 500 };
+    Range clear_ms          { 20, 300 };    // ip_config cleared after link down
+    Range cloud_ms          { 1500, 4000 };
+    Range nvmem_write_ms    { 20, 60 };
+    bool  has_credentials   = true;
+    char  ssid[33]          = "SimNet";
+    int   rssi              = -55;
+    uint8_t lease_ip[4]     { 192, 168, 1, 105 };
+    uint8_t lease_mask[4]   { 255, 255, 255, 0 };
+    uint8_t lease_gw[4]     { 192, 168, 1, 1 };
+    uint8_t lease_dns[4]    { 192, 168, 1, 1 };
+
+    // failure model
+    double bad_dns_rate         = 0.0;  // chance a lease carries 76.83.0.0
+    double bad_dns_after_reset  = 0.0;  // same, for the first lease after netapp_dhcp()
+
+    // name resolution and sockets
+    Range dns_ms            { 20, 150 };
+    uint32_t dns_timeout_ms = 5000;     // gethostbyname() against a dead server
+    Range tcp_connect_ms    { 40, 250 };
+    uint32_t tcp_timeout_ms = 5000;     // connect() to an address nobody answers
+    Range server_ms         { 60, 400 };  // request to first response byte
+    uint32_t link_kbps      = 400;      // response payload rate
+    uint32_t body_bytes     = 512;      // body size of a 200 response
+    uint32_t chunk_bytes    = 0;        // send the body Transfer-Encoding: chunked in chunks this size, 0 = Content-Length
+    uint32_t interim_100    = 0;        // 1 = a 100 Continue ahead of every response
+    uint32_t keepalive_ms   = 5000;     // server closes an idle keep-alive connection, 0 = never keeps one
+    int max_sockets         = 7;
+    bool gateway_dns        = true;     // the access point answers DNS on its own address
+    std::vector<DnsServer> dns_servers;
+    std::vector<HostEntry> hosts;
+
+    // console and runner
+    uint32_t poll_us        = 20;       // cost of one polling API call
+    uint32_t serial_bps     = 0;        // console line rate, 0 = the Serial.begin() baud
+    uint32_t serial_tx_buffer = 64;     // driver transmit FIFO, a write blocks while it is full
+    uint32_t serial_call_us = 30;       // cost of one Serial.write call
+    uint32_t loop_us        = 1000;     // time between two calls to loop()
+    uint32_t idle_exit_ms   = 60000;    // console quiet and no input left
+    uint32_t run_ms         = 600000;   // hard stop, 0 = none
+    bool verbose            = false;    // log simulator events to stderr
+    bool echo_output        = true;     // copy serial output to stdout
+
+    // replay of a field recording: the DHCP leases with their DNS server and
+    // timing, the power up and the cloud connect times come from it, in
+    // order, as the firmware asks for them; the model above takes over
+    // once it runs out
+    Replay replay;
+
+    Config();
+};
+
+struct Stats {
+    uint32_t leases;
+    uint32_t bad_leases;
+    uint32_t nvmem_writes;
+    uint32_t eeprom_writes;
+    uint32_t radio_starts;
+    uint32_t dns_queries;
+    uint32_t dns_failures;
+    uint32_t tcp_connects;
+    uint32_t tcp_failures;
+    uint32_t cloud_connects;
+    uint64_t serial_tx_bytes;
+    uint32_t serial_writes;
+    uint64_t serial_blocked_us;
+    uint32_t replayed;          // leases, power ups and cloud connects from the recording
+    uint32_t replay_beyond;     // drawn from the model after the recording ran out
+};
+
+// Parse one script line ("key value ..."), updating the config and the input
+// schedule.  Returns false and fills err on a malformed line.
+//
+// Settings apply to the whole run, except after "set", which schedules the
+// rest of the line at the current script time, e.g. "set lease_dns 76.83.0.0".
+class Script {
+public:
+    struct Input {
+        uint64_t at_us;
+        std::string bytes;
+    };
+
+    bool parseLine(Config &cfg, const char *line, std::string &err);
+    bool load(Config &cfg, const char *path, std::string &err);
+
+    std::vector<Input> input;       // console input
+    std::vector<Input> changes;     // "set" lines, settings applied at a time
+
+private:
+    uint64_t _cursor_us = 0;
+};
+
+class CC3000 {
+public:
+    CC3000(const Config &cfg, const Script &script);
+
+    // clock
+    uint64_t now() const { return _now; }
+    void advance(uint64_t us);
+    void poll() { advance(_cfg.poll_us); }
+    void step() { advance(_cfg.loop_us); }
+
+    // radio and link
+    void powerOn();
+    void powerOff();
+    bool powered() const { return _power; }
+    void connect();
+    void disconnect();
+    bool connecting() const { return _link == LINK_ASSOCIATING || _link == LINK_LEASING; }
+    bool ready() const { return _link == LINK_UP; }
+    bool listening() const { return _listening; }
+    void setCredentials(bool known) { _credentials = known; }
+    bool hasCredentials() const { return _credentials; }
+    const char *ssid() const;
+    int8_t rssi();
+    void macAddress(uint8_t *mac) const;
+    long setDhcp(const uint8_t *ip, const uint8_t *mask, const uint8_t *gw, const uint8_t *dns);
+    void wlanStop();
+    void wlanStart();
+    tNetappIpconfigRetArgs ipConfig;
+
+    // STM32 flash emulated EEPROM, erased (0xFF) at start
+    uint8_t eepromRead(int addr) const;
+    void eepromWrite(int addr, uint8_t value);
+
+    // cloud
+    void cloudConnect();
+    void cloudDisconnect();
+    bool cloudConnected() const { return _cloud == CLOUD_UP; }
+
+    // System.on() - network_status and cloud_status events
+    bool subscribe(system_event_t events, system_event_handler_t handler);
+
+    // name resolution; returns true with ip in network order
+    bool resolve(const char *host, uint8_t *ip);
+
+    // sockets, all blocking calls advance the clock like the device would
+    int socketOpen();
+    int socketConnect(int sock, const uint8_t *ip, uint16_t port);
+    int socketWrite(int sock, const uint8_t *buf, size_t len);
+    int socketAvailable(int sock);
+    int socketRead(int sock, uint8_t *buf, size_t len, bool peek = false);
+    bool socketConnected(int sock);
+    void socketClose(int sock);
+    int udpSend(int sock, const uint8_t *ip, uint16_t port, const uint8_t *buf, size_t len);
+    int udpReceive(int sock, uint8_t *buf, size_t len, uint8_t *ip, uint16_t *port);
+
+    // serial console
+    void serialBegin(long baud) { _baud = baud; }
+    int serialAvailable();
+    int serialRead(bool peek = false);
+    size_t serialWrite(const uint8_t *buf, size_t len);
+    int serialAvailableForWrite();
+    bool serialIdle();                          // everything written is on the wire
+    void capture(std::string *out) { _capture = out; }  // serial output is appended to out too
+
+    const Stats &stats() const { return _stats; }
+    const Config &config() const { return _cfg; }
+    std::mt19937_64 &rng() { return _rng; }
+    uint32_t draw(const Range &r);
+    bool chance(double p);
+
+private:
+    enum Link { LINK_DOWN, LINK_ASSOCIATING, LINK_LEASING, LINK_UP };
+    enum Cloud { CLOUD_DOWN, CLOUD_CONNECTING, CLOUD_UP };
+    enum EventKind {
+        EV_ASSOCIATED, EV_LEASED, EV_DNS_PUBLISHED, EV_LINK_DOWN,
+        EV_CONFIG_CLEARED, EV_CLOUD_UP, EV_CLOUD_DOWN
+    };
+
+    struct Event {
+        uint64_t at;
+        uint64_t seq;
+        EventKind kind;
+        uint32_t epoch;
+        bool operator>(const Event &e) const { return at != e.at ? at > e.at : seq > e.seq; }
+    };
+
+    struct Datagram {
+        uint64_t at;
+        uint8_t ip[4];
+        uint16_t port;
+        std::string data;
+    };
+
+    struct Socket {
+        bool open;
+        bool connected;
+        uint8_t ip[4];
+        uint16_t port;
+        std::string request;
+        std::string response;
+        size_t rx_pos;
+        uint64_t first_byte_at;
+        bool closing;
+        uint64_t idle_close_at;     // keep-alive, the server closes when idle until then
+        std::vector<Datagram> datagrams;
+    };
+
+    void schedule(uint32_t ms, EventKind kind);
+    void handle(const Event &ev);
+    void dropLink(const char *why);
+    void checkCloud();
+    void notify(system_event_t event, int param);
+    uint32_t replayed(const std::vector<uint32_t> &ms, size_t &next, const Range &model);
+    void serveRequest(Socket &s);
+    size_t socketArrived(const Socket &s) const;
+    bool dnsAnswer(const uint8_t *server, const uint8_t *query, size_t len, Datagram &reply);
+    const HostEntry *findHost(const char *name) const;
+    const HostEntry *findHost(const uint8_t *ip) const;
+    void serialDrain();
+    void log(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    Config _cfg;
+    std::mt19937_64 _rng;
+    uint64_t _now;
+    uint64_t _seq;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event> > _events;
+
+    bool _power;
+    Link _link;
+    uint32_t _linkEpoch;
+    bool _credentials;
+    bool _listening;
+    bool _dhcp;
+    bool _dhcpReset;
+    uint8_t _static[4][4];
+    uint8_t _eeprom[EEPROM_SIZE];
+    uint8_t _pendingDns[4];
+
+    Cloud _cloud;
+    bool _cloudWanted;
+    uint32_t _cloudEpoch;
+
+    std::vector<Socket> _sockets;
+
+    struct Subscriber {
+        system_event_t events;
+        system_event_handler_t handler;
+    };
+    std::vector<Subscriber> _subscribers;
+    // events raised while a handler runs (its micros() moves the clock) wait
+    // for it to return, the system thread delivers them one at a time too
+    std::deque<std::pair<system_event_t, int> > _notifyQueue;
+    bool _notifying;
+
+    std::vector<Script::Input> _input;
+    std::vector<Script::Input> _changes;
+    size_t _changePos;
+    size_t _inputPos;
+    size_t _inputOffset;
+    uint64_t _lastActivity;
+    long _baud;
+    uint32_t _txQueued;         // bytes in the transmit FIFO at _txDrained
+    uint64_t _txDrained;
+    std::string *_capture;
+    const ReplayLease *_lease;  // the recorded lease of the connect in progress, or NULL
+    ReplayLease _leaseCopy;     // ... held here, a "set replay" may swap the recording
+    size_t _replayLease;        // the next of each in the recording
+    size_t _replayPowerOn;
+    size_t _replayCloud;
+
+    Stats _stats;
+};
+
+// The simulator the calling thread's firmware API is routed to
+CC3000 &current();
+void bind(CC3000 *cc3000);
+
+}  // namespace sim
+
+#endif /* CC3000_SIM_H_ */
@@ -0,0 +1,365 @@
+/*
+ *  fleet.cpp  (host build)
+ *
+ *  Runs the DNSTest connect / Fix DNS logic on many simulated Cores at once
+ *  to measure how often FIX_DNS works and how long recovery takes under a
+ *  given policy.
+ *
+ *  Every device has its own simulated CC3000, seeded from its number, and
+ *  its own bad DNS rates drawn around the configured ones, so some access
+ *  points are worse than others.  A cycle connects, waits for the DNS
+ *  server, runs FIX_DNS when it is 76.83.0.0 and disconnects again, driven
+ *  through NetTask exactly as loop() drives it.  Devices are jobs on a work
+ *  stealing pool with one worker per CPU; a device runs start to finish on
+ *  one worker, which its simulator is bound to.
+ *
+ *  usage: dnstest-fleet [-n devices] [-c cycles] [-j threads] [-s script] [setting=value ...]
+ *
+ *      -n devices      default 1000
+ *      -c cycles       connect cycles per device, default 100
+ *      -j threads      default one per CPU
+ *      -s script       simulator settings, as for dnstest-simple
+ *      setting=value   any script setting, or a FIX_DNS policy setting:
+ *                      attempts, backoff, backoff_max (ms), jitter (%),
+ *                      deadline (ms); spread=0.5 draws each device's bad
+ *                      DNS rates within +/- 50% of the configured ones
+ *
+ *  The driver advances the clock loop_us at a time, 10 ms unless set - the
+ *  NetTask waits are polled, so that is the resolution of the times.
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "cc3000_sim.h"
+#include "../firmware/NetTask.h"
+#include "../firmware/Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <string.h>
+
+// The fleet keeps no trace or recording - the rings are one per firmware image
+void trace(TraceEvent event, uint16_t detail)
+{
+}
+
+void traceRecord(TraceRecKind kind, uint8_t param)
+{
+}
+
+void traceRecordConfig(const tNetappIpconfigRetArgs &was, const tNetappIpconfigRetArgs &now)
+{
+}
+
+class NullPrint : public Print {
+public:
+    virtual size_t write(uint8_t c) { return 1; }
+    virtual size_t write(const uint8_t *buffer, size_t size) { return size; }
+    using Print::write;
+};
+
+/*
+ *  Work stealing pool.  Jobs are numbers 0..n-1, dealt out to the workers
+ *  in contiguous blocks.  A worker takes its own jobs from the back and,
+ *  when it has none left, steals from the front of the others, so slow
+ *  devices do not hold up a whole block.
+ */
+class StealingPool {
+public:
+    explicit StealingPool(unsigned workers) : _queues(workers) {}
+
+    void run(uint32_t jobs, const std::function<void(unsigned worker, uint32_t job)> &fn)
+    {
+        unsigned n = _queues.size();
+        for (unsigned w = 0; w < n; w++)
+            for (uint32_t j = (uint64_t) jobs * w / n; j < (uint64_t) jobs * (w + 1) / n; j++)
+                _queues[w].jobs.push_back(j);
+
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < n; w++)
+            threads.push_back(std::thread([this, w, &fn] {
+                uint32_t job;
+                while (take(w, job))
+                    fn(w, job);
+            }));
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    uint64_t steals() const { return _steals; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<uint32_t> jobs;
+    };
+
+    bool take(unsigned worker, uint32_t &job)
+    {
+        {
+            Queue &q = _queues[worker];
+            std::lock_guard<std::mutex> hold(q.lock);
+            if (!q.jobs.empty()) {
+                job = q.jobs.back();
+                q.jobs.pop_back();
+                return true;
+            }
+        }
+        // no job is ever added, so one empty pass over the others means done
+        for (unsigned i = 1; i < _queues.size(); i++) {
+            Queue &q = _queues[(worker + i) % _queues.size()];
+            std::lock_guard<std::mutex> hold(q.lock);
+            if (!q.jobs.empty()) {
+                job = q.jobs.front();
+                q.jobs.pop_front();
+                _steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<Queue> _queues;
+    std::atomic<uint64_t> _steals { 0 };
+};
+
+/*
+ *  Results, one per worker, merged at the end
+ */
+struct Tally {
+    uint64_t devices = 0;
+    uint64_t cycles = 0;
+    uint64_t noLink = 0;        // connect failed
+    uint64_t noDns = 0;         // connected, no DNS server showed up
+    uint64_t badDns = 0;
+    uint64_t fixed = 0;
+    uint64_t fixFailed = 0;
+    uint64_t simUs = 0;
+    std::vector<uint32_t> recoveryMs;   // FIX_DNS start to good DNS, the fixes that worked
+
+    void merge(const Tally &t)
+    {
+        devices += t.devices;
+        cycles += t.cycles;
+        noLink += t.noLink;
+        noDns += t.noDns;
+        badDns += t.badDns;
+        fixed += t.fixed;
+        fixFailed += t.fixFailed;
+        simUs += t.simUs;
+        recoveryMs.insert(recoveryMs.end(), t.recoveryMs.begin(), t.recoveryMs.end());
+    }
+};
+
+struct Fleet {
+    sim::Config cfg;
+    FixDnsPolicy policy;
+    double spread = 0.5;
+    uint32_t devices = 1000;
+    uint32_t cycles = 100;
+};
+
+#define FLEET_DNS_WAIT_MS   1000    // lease to DNS server in ip_config, dns_publish_ms is at most 300
+
+static bool drive(sim::CC3000 &cc, NetTask &task, NetTask::Op op)
+{
+    task.start(op);
+    while (!task.run())
+        cc.step();
+    return task.succeeded();
+}
+
+static double around(std::mt19937_64 &rng, double rate, double spread)
+{
+    double f = 1 - spread + 2 * spread * (rng() % 1000001) / 1e6;
+    return std::min(1.0, rate * f);
+}
+
+static void runDevice(const Fleet &fleet, uint32_t device, Tally &t)
+{
+    sim::Config cfg = fleet.cfg;
+    cfg.seed = fleet.cfg.seed * 1000003 + device;
+    std::mt19937_64 rng(cfg.seed ^ 0x5DEECE66DULL);
+    cfg.bad_dns_rate = around(rng, cfg.bad_dns_rate, fleet.spread);
+    cfg.bad_dns_after_reset = around(rng, cfg.bad_dns_after_reset, fleet.spread);
+
+    sim::Script script;
+    sim::CC3000 cc(cfg, script);
+    sim::bind(&cc);
+    NullPrint quiet;
+    NetTask task(quiet);
+    task.setFixDnsPolicy(fleet.policy);
+
+    try {
+        drive(cc, task, NetTask::CC3000_ON);
+        for (uint32_t c = 0; c < fleet.cycles; c++) {
+            t.cycles++;
+            if (!drive(cc, task, NetTask::WIFI_CONNECT)) {
+                t.noLink++;
+                drive(cc, task, NetTask::WIFI_DISCONNECT);
+                continue;
+            }
+            uint32_t _start = millis();
+            while (!dnsIsSet() && millis() - _start < FLEET_DNS_WAIT_MS)
+                cc.step();
+            if (!dnsIsSet())
+                t.noDns++;
+            else if (dnsIsBad()) {
+                t.badDns++;
+                if (drive(cc, task, NetTask::FIX_DNS)) {
+                    t.fixed++;
+                    t.recoveryMs.push_back(task.timeToGoodDns());
+                } else
+                    t.fixFailed++;
+            }
+            drive(cc, task, NetTask::WIFI_DISCONNECT);
+        }
+    } catch (const sim::EndOfScript &) {
+    }
+    t.devices++;
+    t.simUs += cc.now();
+    sim::bind(NULL);
+}
+
+static double pct(uint64_t n, uint64_t of)
+{
+    return of ? 100.0 * n / of : 0;
+}
+
+static void report(const Fleet &fleet, Tally &t, unsigned threads, uint64_t steals, double wallS)
+{
+    printf("fleet: %u devices x %u cycles on %u threads, %llu cycles in %.1f s, %.0f x real time, %llu steals\n",
+        fleet.devices, fleet.cycles, threads, (unsigned long long) t.cycles, wallS,
+        wallS > 0 ? t.simUs / 1e6 / wallS : 0, (unsigned long long) steals);
+    printf("policy: attempts %u  backoff %u ms  max %u ms  jitter %u%%  deadline %u ms\n",
+        fleet.policy.attempts, fleet.policy.backoff, fleet.policy.backoffMax, fleet.policy.jitter,
+        fleet.policy.deadline);
+    printf("   no link     %10llu  %5.1f%%\n", (unsigned long long) t.noLink, pct(t.noLink, t.cycles));
+    printf("   no dns      %10llu  %5.1f%%\n", (unsigned long long) t.noDns, pct(t.noDns, t.cycles));
+    printf("   bad dns     %10llu  %5.1f%%\n", (unsigned long long) t.badDns, pct(t.badDns, t.cycles));
+    printf("   fixed       %10llu  %5.1f%% of bad\n", (unsigned long long) t.fixed, pct(t.fixed, t.badDns));
+    printf("   fix failed  %10llu  %5.1f%% of bad\n", (unsigned long long) t.fixFailed, pct(t.fixFailed, t.badDns));
+
+    std::vector<uint32_t> &r = t.recoveryMs;
+    if (r.empty())
+        return;
+    std::sort(r.begin(), r.end());
+    uint64_t sum = 0;
+    for (size_t i = 0; i < r.size(); i++)
+        sum += r[i];
+    static const uint8_t percentiles[] = { 50, 90, 95, 99 };
+    printf("   recovery s  min %.1f", r.front() / 1000.0);
+    for (size_t i = 0; i < sizeof(percentiles); i++)
+        printf("  p%u %.1f", percentiles[i], r[(r.size() - 1) * percentiles[i] / 100] / 1000.0);
+    printf("  max %.1f  mean %.1f\n", r.back() / 1000.0, sum / 1000.0 / r.size());
+
+    // the distribution in 2 s buckets, the tail folded into the last one
+    const uint32_t width = 2000, buckets = 15;
+    uint64_t count[buckets] = { 0 };
+    for (size_t i = 0; i < r.size(); i++)
+        count[std::min<uint32_t>(r[i] / width, buckets - 1)]++;
+    for (uint32_t b = 0; b < buckets; b++) {
+        if (!count[b])
+            continue;
+        if (b + 1 < buckets)
+            printf("   %3u-%-3u s %10llu  ", b * width / 1000, (b + 1) * width / 1000, (unsigned long long) count[b]);
+        else
+            printf("   %3u+    s %10llu  ", b * width / 1000, (unsigned long long) count[b]);
+        for (uint32_t n = (uint32_t) (count[b] * 50 / r.size()); n; n--)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-n devices] [-c cycles] [-j threads] [-s script] [setting=value ...]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    Fleet fleet;
+    sim::Script script;
+    std::string err;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    fleet.cfg.loop_us = 10000;
+    fleet.cfg.bad_dns_rate = 0.3;
+    fleet.cfg.bad_dns_after_reset = 0.1;
+    fleet.cfg.run_ms = 0;
+    fleet.cfg.echo_output = false;
+    fleet.policy = FixDnsPolicy { FIX_DNS_ATTEMPTS, FIX_DNS_BACKOFF, FIX_DNS_BACKOFF_MAX, FIX_DNS_JITTER, FIX_DNS_DEADLINE };
+
+    struct { const char *name; uint32_t *v; } counts[] = {
+        { "-n", &fleet.devices }, { "-c", &fleet.cycles },
+    };
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool counted = false;
+        for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+            if (!strcmp(arg, counts[k].name) && i + 1 < argc) {
+                *counts[k].v = strtoul(argv[++i], NULL, 10);
+                counted = true;
+            }
+        if (counted)
+            continue;
+        if (!strcmp(arg, "-j") && i + 1 < argc)
+            threads = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        else if (!strcmp(arg, "-s") && i + 1 < argc) {
+            if (!script.load(fleet.cfg, argv[++i], err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+        } else if (strchr(arg, '=') && arg[0] != '-') {
+            std::string key(arg, strchr(arg, '=') - arg);
+            const char *val = strchr(arg, '=') + 1;
+            FixDnsPolicy &p = fleet.policy;
+            if (key == "attempts")
+                p.attempts = strtoul(val, NULL, 10);
+            else if (key == "backoff")
+                p.backoff = strtoul(val, NULL, 10);
+            else if (key == "backoff_max")
+                p.backoffMax = strtoul(val, NULL, 10);
+            else if (key == "jitter")
+                p.jitter = strtoul(val, NULL, 10);
+            else if (key == "deadline")
+                p.deadline = strtoul(val, NULL, 10);
+            else if (key == "spread")
+                fleet.spread = strtod(val, NULL);
+            else {
+                std::string line(arg);
+                for (size_t j = 0; j < line.size(); j++)
+                    if (line[j] == '=' || line[j] == ',')
+                        line[j] = ' ';
+                if (!script.parseLine(fleet.cfg, line.c_str(), err)) {
+                    fprintf(stderr, "%s\n", err.c_str());
+                    return 2;
+                }
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    fleet.cfg.echo_output = false;
+
+    std::vector<Tally> tallies(threads);
+    StealingPool pool(threads);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.run(fleet.devices, [&fleet, &tallies](unsigned worker, uint32_t device) {
+        runDevice(fleet, device, tallies[worker]);
+    });
+    double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Tally total;
+    for (size_t i = 0; i < tallies.size(); i++)
+        total.merge(tallies[i]);
+    report(fleet, total, threads, pool.steals(), wallS);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ *  main.cpp  (host build)
+ *
+ *  Runs the DNSTest firmware against the simulated CC3000.  Serial input
+ *  comes from a script, from -k, or from stdin; serial output goes to
+ *  stdout and a summary of the simulated run goes to stderr.
+ *
+ *  usage: dnstest-simple [-s script] [-k keys] [-v] [-q] [setting=value ...]
+ *
+ *      -s script       simulator settings and timed console input, see
+ *                      the examples in scripts/ for the format
+ *      -k keys         console input sent at t=0, \r \n \xHH escapes allowed
+ *      -v              log simulator events to stderr
+ *      -q              do not echo the serial output
+ *      setting=value   any script setting, e.g. bad_dns_rate=0.5 or
+ *                      assoc_ms=800,1200
+ *
+ *  License:  GPL v3 (http://www.gnu.org/licenses/gpl.html)
+ */
+
+#include "cc3000_sim.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-s script] [-k keys] [-v] [-q] [setting=value ...]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    sim::Config cfg;
+    sim::Script script;
+    std::string err;
+    bool haveInput = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-s") && i + 1 < argc) {
+            if (!script.load(cfg, argv[++i], err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+            haveInput = true;
+        } else if (!strcmp(arg, "-k") && i + 1 < argc) {
+            std::string line = std::string("send ") + argv[++i];
+            script.parseLine(cfg, line.c_str(), err);
+            haveInput = true;
+        } else if (!strcmp(arg, "-v"))
+            cfg.verbose = true;
+        else if (!strcmp(arg, "-q"))
+            cfg.echo_output = false;
+        else if (strchr(arg, '=') && arg[0] != '-') {
+            std::string line(arg);
+            for (size_t j = 0; j < line.size(); j++)
+                if (line[j] == '=' || line[j] == ',')
+                    line[j] = ' ';
+            if (!script.parseLine(cfg, line.c_str(), err)) {
+                fprintf(stderr, "%s\n", err.c_str());
+                return 2;
+            }
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Nothing scripted: take the console input from a pipe
+    if (!haveInput && !isatty(0)) {
+        std::string keys;
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)
+            keys.append(buf, n);
+        sim::Script::Input in = { 0, keys };
+        script.input.push_back(in);
+    }
+
+    sim::CC3000 cc3000(cfg, script);
+    sim::bind(&cc3000);
+
+    try {
+        setup();
+        for (;;) {
+            loop();
+            cc3000.step();
+        }
+    } catch (const sim::EndOfScript &) {
+    }
+    fflush(stdout);
+
+    const sim::Stats &st = cc3000.stats();
+    fprintf(stderr,
+        "\nsim: %.3f s simulated, leases %u (bad dns %u), nvmem writes %u, eeprom writes %u, radio starts %u,"
+        " dns %u (failed %u), tcp %u (failed %u), cloud %u, serial tx %llu bytes"
+        " in %u writes, blocked %.3f s\n",
+        cc3000.now() / 1e6, st.leases, st.bad_leases, st.nvmem_writes, st.eeprom_writes, st.radio_starts,
+        st.dns_queries, st.dns_failures, st.tcp_connects, st.tcp_failures, st.cloud_connects,
+        (unsigned long long) st.serial_tx_bytes, st.serial_writes, st.serial_blocked_us / 1e6);
+    if (!cfg.replay.empty())
+        fprintf(stderr, "sim: replayed %u times from a recording of %zu leases, %zu power ups and %zu cloud connects,"
+            " %u drawn from the model after it ran out\n",
+            st.replayed, cfg.replay.leases.size(), cfg.replay.power_on_ms.size(), cfg.replay.cloud_ms.size(),
+            st.replay_beyond);
+    sim::bind(NULL);
+    return 0;
+}